@@ -6,134 +6,5167 @@
 #include <assert.h>
 #include <math.h>
 
+#ifndef _MSC_VER
+#include <unistd.h>
+#endif
+
 #include "blur.h"
+#include "fft.h"
+#include "simd.h"
+#include "pool.h"
+
+#define M_PI 3.14159265358979323846
+
+/* Components of a pixel gaussianBlurPlanar() can split into planes */
+#define MAX_COMPONENTS 32
+
+/* Sigma from which BLUR_AUTO prefers the recursive filter */
+#define RECURSIVE_SIGMA 4.0
+
+/* Least sigma left for the coarsest level of a pyramid, in its pixels */
+#define PYRAMID_SIGMA 2.0
+
+/* Boxes per pixel variableBlur() cascades at most */
+#define MAX_VARIABLE_PASSES 5
+
+/* Variance below which anisotropicBlur() takes a pass as the identity */
+#define MIN_VARIANCE 1e-4
+
+/* Cache assumed where it cannot be queried, and the smallest tile, in
+   pixels, worth the overhead of its halo */
+#define DEFAULT_CACHE_SIZE (256 * 1024)
+#define MIN_TILE_SIZE 16
+
+
+/* Side of tiles, as set by setTileSize(); 0 to derive it from the cache */
+static int tileOverride = 0;
+
+/* Samples beyond the edge of the image, as set by setBorder() */
+static BorderMode borderMode = BORDER_CLAMP;
+static uint8_t borderValue = 0;
+
+/* Weight of the blur per pixel, as set by setMask(); NULL for the ramp */
+static const uint8_t *blurMask = NULL;
+
+/* Pixels to blur, as set by setShape(); NULL for the mask or the ramp */
+static const Shape *blurShape = NULL;
+
+/* Curve of the ramp and its parameter, as set by setFalloff() */
+static Falloff falloffCurve = FALLOFF_LINEAR;
+static double falloffParameter = 1;
+
+
+/* Falloff of a rectangle as passed to an engine, by way of its table of
+   cachedFalloff() where the cache holds one */
+typedef struct
+{
+  int minX;               // of rectangle
+  int minY;               //
+  int width;              // of curve; the height is that of the rectangle
+  int height;             //   for FALLOFF_ELLIPTICAL, else its width
+  const double *table;    // NULL to evaluate weights per pixel
+} Ramp;
+
+
+/* Areas sharing the region of an engine, while gaussianBlurAreas() runs;
+   the image is then already copied, and each area has its own falloff */
+static const Area *blendAreas = NULL;
+static const Ramp *blendRamps = NULL;
+static int blendAreaCount = 0;
+
+
+/* Weight of a falloff at an offset of (dx, dy) from the center of its
+   rectangle; 1 at the center and 0 from its inscribed circle or ellipse */
+static double falloffAt(const Falloff falloff,
+                        const double parameter,
+                        const int dx,
+                        const int dy,
+                        const int width,
+                        const int height)
+{
+  double v;
+
+  if (falloff == FALLOFF_ELLIPTICAL)
+  {
+    double x = dx * (2.0 / width);
+    double y = dy * (2.0 / height);
+    v = sqrt(x * x + y * y);
+  }
+  else
+  {
+    v = sqrt(dx * dx + dy * dy);
+    v *= 2;              // radius to diameter
+    v *= 1.0 / width;    // fit
+  }
+
+  if (falloff == FALLOFF_GAUSSIAN)
+  {
+    return v < 1 ? exp(-v * v / (2 * parameter * parameter)) : 0;
+  }
+
+  v = 1 - v;           // inverse
+  v = v > 0 ? v : 0;   // clamp
+
+  if (falloff == FALLOFF_SMOOTHSTEP)
+  {
+    v = v * v * (3 - 2 * v);
+  }
+  else if (falloff == FALLOFF_GAMMA && v > 0)
+  {
+    v = pow(v, parameter);
+  }
+
+  return v;
+}
+
+
+/* Set up the falloff of a rectangle, looking up its table if /p lookup
+   and neither a mask nor a shape is set */
+static void setupRamp(Ramp *ramp,
+                      const int minX,
+                      const int minY,
+                      const int maxX,
+                      const int maxY,
+                      const bool lookup)
+{
+  ramp->minX = minX;
+  ramp->minY = minY;
+  ramp->width = maxX - minX;
+  ramp->height = falloffCurve == FALLOFF_ELLIPTICAL ? maxY - minY : ramp->width;
+  ramp->table = lookup && blurMask == NULL && blurShape == NULL
+    ? cachedFalloff(falloffCurve, falloffParameter, ramp->width, ramp->height)
+    : NULL;
+}
+
+
+/* Weight of a falloff at pixel (w, h) of the image */
+static double rampWeight(const Ramp *ramp, const int w, const int h)
+{
+  int dx = abs(ramp->width / 2 - (w - ramp->minX));
+  int dy = abs(ramp->height / 2 - (h - ramp->minY));
+  int columns = ramp->width / 2 + 2;
+
+  /* Beyond the radius, as is all outside of the table */
+  if (dx >= columns || dy >= ramp->height / 2 + 2)
+  {
+    return 0;
+  }
+
+  if (ramp->table != NULL)
+  {
+    return ramp->table[(size_t) dy * columns + dx];
+  }
+
+  return falloffAt(falloffCurve, falloffParameter,
+                   dx, dy, ramp->width, ramp->height);
+}
+
+
+/* Strongest falloff of the areas of gaussianBlurAreas() at (w, h); each
+   is 0 outside of its area, as its ramp reaches 0 at its inscribed circle */
+static double areasFalloff(const int w, const int h)
+{
+  double strongest = 0;
+
+  for (int a = 0; a < blendAreaCount; a++)
+  {
+    double v = rampWeight(&blendRamps[a], w, h);
+
+    strongest = v > strongest ? v : strongest;
+  }
+
+  return strongest;
+}
+
+
+/* Round and clamp to the range of a component */
+static uint8_t saturate(const double v)
+{
+  if (v <= 0) return 0;
+  if (v >= 255) return 255;
+  return (uint8_t) (v + 0.5);
+}
+
+
+static uint16_t saturate16(const double v)
+{
+  if (v <= 0) return 0;
+  if (v >= 65535) return 65535;
+  return (uint16_t) (v + 0.5);
+}
+
+
+/* Index of pixel /p i of a row or column of /p n pixels, where beyond
+   either end indices map back into it by the border mode
+
+  i       -3 -2 -1 | 0  1  2  3 | 4  5  6
+  clamp    0  0  0 | 0  1  2  3 | 3  3  3
+  mirror   3  2  1 | 0  1  2  3 | 2  1  0
+  wrap     1  2  3 | 0  1  2  3 | 0  1  2
+
+Returns -1 for the constant border.
+
+*/
+static int borderIndex(int i, const int n)
+{
+  if (i >= 0 && i < n)
+  {
+    return i;
+  }
+
+  if (borderMode == BORDER_CONSTANT)
+  {
+    return -1;
+  }
+
+  if (borderMode == BORDER_WRAP)
+  {
+    i %= n;
+    return i < 0 ? i + n : i;
+  }
+
+  if (borderMode == BORDER_MIRROR && n > 1)
+  {
+    int period = 2 * (n - 1);
+    i %= period;
+    i = i < 0 ? i + period : i;
+    return i < n ? i : period - i;
+  }
+
+  return i < 0 ? 0 : n - 1;
+}
+
+
+void setBorder(const BorderMode mode, const uint8_t value)
+{
+  borderMode = mode;
+  borderValue = value;
+}
+
+
+void setMask(const uint8_t *mask)
+{
+  blurMask = mask;
+}
+
+
+void setShape(const Shape *shape)
+{
+  blurShape = shape;
+}
+
+
+bool setFalloff(const Falloff falloff, const double parameter)
+{
+  bool parametric = falloff == FALLOFF_GAMMA || falloff == FALLOFF_GAUSSIAN;
+
+  if (parametric && !(parameter > 0))
+  {
+    return false;
+  }
+
+  falloffCurve = falloff;
+  falloffParameter = parametric ? parameter : 1;
+
+  return true;
+}
+
+
+bool maskBounds(const uint8_t *mask,
+                const int width,
+                const int height,
+                int *minX,
+                int *minY,
+                int *maxX,
+                int *maxY)
+{
+  int x0 = width, y0 = height, x1 = -1, y1 = -1;
+
+  for (int h = 0; h < height; h++)
+  {
+    const uint8_t *weight = mask + (size_t) h * width;
+
+    for (int w = 0; w < width; w++)
+    {
+      if (weight[w] != 0)
+      {
+        x0 = w < x0 ? w : x0;
+        x1 = w > x1 ? w : x1;
+        y0 = h < y0 ? h : y0;
+        y1 = h;
+      }
+    }
+  }
+
+  *minX = x0;
+  *minY = y0;
+  *maxX = x1;
+  *maxY = y1;
+
+  return x1 >= 0;
+}
+
+
+/* Rectangle of an engine, clipped to the image, and the padding around it
+   which its kernel reads from */
+typedef struct
+{
+  int width;              // of image
+  int height;             //
+  int components;         //
+  PixelType type;         // of components
+  const void *in;         //
+  void *out;              //
+  Ramp ramp;              // of rectangle as passed
+  int x0;                 // rectangle clipped to image, inclusive
+  int y0;                 //
+  int x1;                 //
+  int y1;                 //
+  int pad;                // pixels of padding on every side
+  int regionWidth;        //
+  int regionHeight;       //
+  int paddedWidth;        //
+  int paddedHeight;       //
+  int stride;             // values per row of rectangle
+  int paddedStride;       // values per row of padded rectangle
+} Region;
+
+
+/* Dimensions of a region, from its rectangle and padding */
+static void measureRegion(Region *region)
+{
+  region->regionWidth = region->x1 - region->x0 + 1;
+  region->regionHeight = region->y1 - region->y0 + 1;
+  region->paddedWidth = region->regionWidth + 2 * region->pad;
+  region->paddedHeight = region->regionHeight + 2 * region->pad;
+  region->stride = region->regionWidth * region->components;
+  region->paddedStride = region->paddedWidth * region->components;
+}
+
+
+/* Clip a rectangle to the image
+
+Returns false if nothing of the rectangle lies within the image.
+
+*/
+static bool clipRegion(Region *region,
+                       const int width,
+                       const int height,
+                       const int minX,
+                       const int minY,
+                       const int maxX,
+                       const int maxY,
+                       const int components,
+                       const PixelType type,
+                       const void *in,
+                       void *out,
+                       const int pad)
+{
+  region->width = width;
+  region->height = height;
+  region->components = components;
+  region->type = type;
+  region->in = in;
+  region->out = out;
+  setupRamp(&region->ramp, minX, minY, maxX, maxY, blendAreas == NULL);
+
+  region->x0 = minX > 0 ? minX : 0;
+  region->y0 = minY > 0 ? minY : 0;
+  region->x1 = maxX < width - 1 ? maxX : width - 1;
+  region->y1 = maxY < height - 1 ? maxY : height - 1;
+
+  region->pad = pad;
+  measureRegion(region);
+
+  return region->x0 <= region->x1 && region->y0 <= region->y1;
+}
+
+
+/* Square tiles a region is split into, row by row
+
+   x0                 x1
+  y0 ____ ____ ____ __
+    |  0 |  1 |  2 |3 |
+    |____|____|____|__|
+    |  4 |  5 |  6 |7 |
+  y1|____|____|____|__|
+
+Each tile is processed along with its own padding, such that a tile and
+its halo stay in cache for all passes over it.
+
+*/
+typedef struct
+{
+  int size;               // pixels along either side
+  int columns;            //
+  int count;              //
+} Tiling;
+
+
+/* Tiles of at most /p size pixels, made smaller until there is one for
+   every thread of the pool */
+static void computeTiling(Tiling *tiling, const Region *region, const int size)
+{
+  int longest = region->regionWidth > region->regionHeight
+    ? region->regionWidth
+    : region->regionHeight;
+
+  tiling->size = size < longest ? size : longest;
+
+  for (;;)
+  {
+    tiling->columns = (region->regionWidth + tiling->size - 1) / tiling->size;
+    tiling->count = tiling->columns
+      * ((region->regionHeight + tiling->size - 1) / tiling->size);
+
+    if (tiling->count >= threadCount() || tiling->size <= MIN_TILE_SIZE)
+    {
+      break;
+    }
+
+    tiling->size = tiling->size / 2 > MIN_TILE_SIZE ? tiling->size / 2 : MIN_TILE_SIZE;
+  }
+}
+
+
+/* The /p index-th tile of a region, padded alike */
+static void selectTile(Region *tile,
+                       const Region *region,
+                       const Tiling *tiling,
+                       const int index)
+{
+  *tile = *region;
+
+  tile->x0 = region->x0 + (index % tiling->columns) * tiling->size;
+  tile->y0 = region->y0 + (index / tiling->columns) * tiling->size;
+  tile->x1 = tile->x0 + tiling->size - 1;
+  tile->y1 = tile->y0 + tiling->size - 1;
+  tile->x1 = tile->x1 < region->x1 ? tile->x1 : region->x1;
+  tile->y1 = tile->y1 < region->y1 ? tile->y1 : region->y1;
+
+  measureRegion(tile);
+}
+
+
+/* Chord of row /p h through the inscribed circle or ellipse of a ramp,
+   beyond which it is 0; widened by a pixel, as the falloff itself
+   decides on the edge */
+static void chordSpan(const Ramp *ramp, const int h, int *begin, int *end)
+{
+  int centerX = ramp->width / 2;
+  int dy = abs(ramp->height / 2 - (h - ramp->minY));
+  double radiusX = ramp->width * 0.5;
+  double radiusY = ramp->height * 0.5;
+
+  if (dy >= radiusY + 1)
+  {
+    *begin = *end = ramp->minX;
+    return;
+  }
+
+  double squared = radiusY > 0 ? 1 - (dy / radiusY) * (dy / radiusY) : 0;
+  int dx = (int) (radiusX * sqrt(squared > 0 ? squared : 0)) + 1;
+
+  *begin = ramp->minX + centerX - dx;
+  *end = ramp->minX + centerX + dx + 1;
+}
+
+
+/* Columns /p begin up to /p end of row /p h of a region which are weighed
+   above 0; by the shape or the mask if set, else by the areas or the ramp
+
+Pixels outside of the span are weighed at 0 and left as copied, such that
+engines need not blur them at all. For the ramp, that is all of the
+rectangle outside of its inscribed circle.
+
+   ____________
+  |   ______   |
+  |  /      \  |
+  |-|--span--|-|   <- row h
+  |  \______/  |
+  |____________|
+
+*/
+static void weightSpan(const Region *region, const int h, int *begin, int *end)
+{
+  int first = region->x1 + 1;
+  int last = region->x0;
+
+  if (blurShape != NULL)
+  {
+    int runFirst = blurShape->rows[h];
+    int runLast = blurShape->rows[h + 1];
+
+    if (runFirst < runLast)
+    {
+      first = blurShape->runs[2 * runFirst];
+      last = blurShape->runs[2 * runLast - 1];
+    }
+  }
+  else if (blurMask != NULL)
+  {
+    const uint8_t *weight = blurMask + (size_t) h * region->width;
+
+    for (int w = region->x0; w <= region->x1; w++)
+    {
+      if (weight[w] != 0)
+      {
+        first = w < first ? w : first;
+        last = w + 1;
+      }
+    }
+  }
+  else if (blendAreas != NULL)
+  {
+    for (int a = 0; a < blendAreaCount; a++)
+    {
+      int areaBegin, areaEnd;
+      chordSpan(&blendRamps[a], h, &areaBegin, &areaEnd);
+
+      if (areaBegin < areaEnd)
+      {
+        first = areaBegin < first ? areaBegin : first;
+        last = areaEnd > last ? areaEnd : last;
+      }
+    }
+  }
+  else
+  {
+    chordSpan(&region->ramp, h, &first, &last);
+  }
+
+  first = first > region->x0 ? first : region->x0;
+  last = last < region->x1 + 1 ? last : region->x1 + 1;
+
+  *begin = first;
+  *end = last > first ? last : first;
+}
+
+
+/* Runs of row /p h of a region weighed above 0, as pairs of their first
+   column and the one past their last; those of the shape if one is set,
+   else the span of weightSpan() alone, which /p span holds either way
+
+Returns the count of runs, each of which is to be clipped to /p span.
+Pixels between the runs of a shape are never looked at.
+
+*/
+static int weightRuns(const Region *region,
+                      const int h,
+                      int *span,
+                      const int **runs)
+{
+  weightSpan(region, h, &span[0], &span[1]);
+
+  if (blurShape == NULL)
+  {
+    *runs = span;
+    return span[0] < span[1] ? 1 : 0;
+  }
+
+  *runs = blurShape->runs + 2 * blurShape->rows[h];
+
+  return blurShape->rows[h + 1] - blurShape->rows[h];
+}
+
+
+/* Span of weightSpan() of each row of a tile, as the pair of its first
+   value and the value past it, within the row of the tile; returns false
+   if all are empty */
+static bool tileSpans(const Region *tile, int *spans)
+{
+  bool any = false;
+
+  for (int r = 0; r < tile->regionHeight; r++)
+  {
+    int begin, end;
+    weightSpan(tile, tile->y0 + r, &begin, &end);
+
+    spans[2 * r] = (begin - tile->x0) * tile->components;
+    spans[2 * r + 1] = (end - tile->x0) * tile->components;
+    any = any || begin < end;
+  }
+
+  return any;
+}
+
+
+/* Union of the spans of rows /p first up to /p last of a tile, of its
+   /p rows; i.e. the values of a row a vertical pass reads from */
+static void spanUnion(const int *spans,
+                      const int rows,
+                      const int first,
+                      const int last,
+                      int *begin,
+                      int *end)
+{
+  bool found = false;
+  *begin = *end = 0;
+
+  for (int r = first > 0 ? first : 0; r < last && r < rows; r++)
+  {
+    if (spans[2 * r] == spans[2 * r + 1])
+    {
+      continue;
+    }
+
+    *begin = found && *begin < spans[2 * r] ? *begin : spans[2 * r];
+    *end = found && *end > spans[2 * r + 1] ? *end : spans[2 * r + 1];
+    found = true;
+  }
+}
+
+
+/* Whether every pixel of a tile is weighed at 0, such that blurring it
+   can be skipped altogether */
+static bool tileMasked(const Region *tile)
+{
+  for (int h = tile->y0; h <= tile->y1; h++)
+  {
+    int begin, end;
+    weightSpan(tile, h, &begin, &end);
+
+    if (begin < end)
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+
+/* Bytes of the second level cache, or a conservative guess */
+static long cacheSize(void)
+{
+  static long size = 0;
+
+  if (size == 0)
+  {
+#ifdef _SC_LEVEL2_CACHE_SIZE
+    size = sysconf(_SC_LEVEL2_CACHE_SIZE);
+#endif
+    size = size > 0 ? size : DEFAULT_CACHE_SIZE;
+  }
+
+  return size;
+}
+
+
+/* Side of tiles which, along with a halo of /p margin pixels, fill half
+   the cache; the other half is left to the rows of in and out */
+static int computeTileSize(const int bytesPerPixel, const int margin)
+{
+  if (tileOverride > 0)
+  {
+    return tileOverride;
+  }
+
+  int size = (int) sqrt(cacheSize() / 2.0 / bytesPerPixel) - 2 * margin;
+
+  return size > MIN_TILE_SIZE ? size : MIN_TILE_SIZE;
+}
+
+
+void setTileSize(const int size)
+{
+  tileOverride = size > 0 ? size : 0;
+}
+
+
+typedef struct
+{
+  const uint8_t *in;
+  uint8_t *out;
+  size_t rowSize;
+} CopyContext;
+
+
+static void copyRows(void *context, const int first, const int last)
+{
+  CopyContext *copy = (CopyContext *) context;
+
+  memcpy(copy->out + (size_t) first * copy->rowSize,
+         copy->in + (size_t) first * copy->rowSize,
+         (size_t) (last - first) * copy->rowSize);
+}
+
+
+/* Copy a whole image, on the shared pool */
+static void copyImage(const void *in,
+                      void *out,
+                      const int width,
+                      const int height,
+                      const int bytesPerPixel)
+{
+  CopyContext copy = { (const uint8_t *) in, (uint8_t *) out,
+                       (size_t) width * bytesPerPixel };
+  parallelFor(height, copyRows, &copy);
+}
+
+
+/* Pixels outside of the rectangle of an engine pass through untouched;
+   gaussianBlurAreas() copies them once up front for all of its areas */
+static void copyUntouched(const void *in,
+                          void *out,
+                          const int width,
+                          const int height,
+                          const int bytesPerPixel)
+{
+  if (blendAreas == NULL)
+  {
+    copyImage(in, out, width, height, bytesPerPixel);
+  }
+}
+
+
+/* Loops specialised per type of component
+
+Each is defined once per PixelType by the macros below and picked from
+a table once per row, such that no sample is converted by way of a
+branch.
+
+*/
+#define DEFINE_COPY_RUN(name, T)                                        \
+  static void name(const void *source, float *target, const int count)  \
+  {                                                                     \
+    const T *values = (const T *) source;                               \
+                                                                        \
+    for (int i = 0; i < count; i++)                                     \
+    {                                                                   \
+      target[i] = (float) values[i];                                    \
+    }                                                                   \
+  }
+
+DEFINE_COPY_RUN(copyRunU8, uint8_t)
+DEFINE_COPY_RUN(copyRunU16, uint16_t)
+DEFINE_COPY_RUN(copyRunF32, float)
+
+static void (*const copyRuns[])(const void *, float *, const int) = {
+  copyRunU8, copyRunU16, copyRunF32
+};
+
+
+/* Component /p i of a row, as a float; for the few samples off the fast path */
+static float loadComponent(const void *row, const size_t i, const PixelType type)
+{
+  switch (type)
+  {
+    case PIXEL_U16: return ((const uint16_t *) row)[i];
+    case PIXEL_F32: return ((const float *) row)[i];
+    default:        return ((const uint8_t *) row)[i];
+  }
+}
+
+
+/* Store /p count values of a row, rounded and clamped to /p type */
+static void storeRow(void *row, const float *values, const PixelType type, const int count)
+{
+  for (int i = 0; type == PIXEL_U8 && i < count; i++)
+  {
+    ((uint8_t *) row)[i] = saturate(values[i]);
+  }
+
+  for (int i = 0; type == PIXEL_U16 && i < count; i++)
+  {
+    ((uint16_t *) row)[i] = saturate16(values[i]);
+  }
+
+  if (type == PIXEL_F32)
+  {
+    memcpy(row, values, count * sizeof(float));
+  }
+}
+
+
+/* The constant border, on the scale of /p type */
+static float borderComponent(const PixelType type)
+{
+  switch (type)
+  {
+    case PIXEL_U16: return borderValue * 257.0f;
+    case PIXEL_F32: return borderValue / 255.0f;
+    default:        return borderValue;
+  }
+}
+
+
+typedef struct
+{
+  const Region *region;
+  float *target;
+  uint8_t *targetFixed;
+} PaddedContext;
+
+
+/* Padded columns /p begin up to /p end of a region, which lie within the
+   image and are copied as they are */
+static void interiorColumns(const Region *region, int *begin, int *end)
+{
+  int offset = region->x0 - region->pad;
+
+  *begin = offset < 0 ? -offset : 0;
+  *end = region->width - offset;
+  *end = *end < region->paddedWidth ? *end : region->paddedWidth;
+  *end = *end > *begin ? *end : *begin;
+}
+
+
+static void copyPaddedRows(void *context, const int first, const int last)
+{
+  PaddedContext *padded = (PaddedContext *) context;
+  const Region *region = padded->region;
+  int components = region->components;
+  int offset = region->x0 - region->pad;
+
+  int begin, end;
+  interiorColumns(region, &begin, &end);
+
+  size_t size = pixelTypeSize(region->type);
+  float constant = borderComponent(region->type);
+
+  for (int r = first; r < last; r++)
+  {
+    int row = borderIndex(region->y0 - region->pad + r, region->height);
+    float *target = padded->target + (size_t) r * region->paddedStride;
+
+    if (row < 0)
+    {
+      for (int i = 0; i < region->paddedStride; i++)
+      {
+        target[i] = constant;
+      }
+
+      continue;
+    }
+
+    const uint8_t *source = (const uint8_t *) region->in
+      + (size_t) row * region->width * components * size;
+
+    copyRuns[region->type](source + (size_t) (offset + begin) * components * size,
+                           target + begin * components,
+                           (end - begin) * components);
+
+    /* Only the halo beyond the left and right edge is looked up */
+    for (int x = begin > 0 ? 0 : end; x < region->paddedWidth; x = x + 1 == begin ? end : x + 1)
+    {
+      int col = borderIndex(offset + x, region->width);
+
+      for (int c = 0; c < components; c++)
+      {
+        target[x * components + c] = col < 0
+          ? constant
+          : loadComponent(source, (size_t) col * components + c, region->type);
+      }
+    }
+  }
+}
+
+
+static void copyPaddedFixedRows(void *context, const int first, const int last)
+{
+  PaddedContext *padded = (PaddedContext *) context;
+  const Region *region = padded->region;
+  int components = region->components;
+  int offset = region->x0 - region->pad;
+
+  int begin, end;
+  interiorColumns(region, &begin, &end);
+
+  for (int r = first; r < last; r++)
+  {
+    int row = borderIndex(region->y0 - region->pad + r, region->height);
+    uint8_t *target = padded->targetFixed + (size_t) r * region->paddedStride;
+
+    if (row < 0)
+    {
+      memset(target, borderValue, region->paddedStride * sizeof(uint8_t));
+      continue;
+    }
+
+    const uint8_t *source = (const uint8_t *) region->in
+      + (size_t) row * region->width * components;
+
+    memcpy(target + begin * components,
+           source + (offset + begin) * components,
+           (end - begin) * components * sizeof(uint8_t));
+
+    /* Only the halo beyond the left and right edge is looked up */
+    for (int x = begin > 0 ? 0 : end; x < region->paddedWidth; x = x + 1 == begin ? end : x + 1)
+    {
+      int col = borderIndex(offset + x, region->width);
+
+      for (int c = 0; c < components; c++)
+      {
+        target[x * components + c] = col < 0 ? borderValue : source[col * components + c];
+      }
+    }
+  }
+}
+
+
+/* Copy the rectangle of a region and its padding, clamped to the nearest edge */
+static void copyPadded(const Region *region, float *out)
+{
+  PaddedContext padded = { region, out, NULL };
+  parallelFor(region->paddedHeight, copyPaddedRows, &padded);
+}
+
+
+/* Mix a row of blurred pixels into the output by the falloff of the area,
+   or by the mask if one is set, stored by /p store to the range of /p T
+
+Each pixel takes one of three paths by its weight; those at 0 are left
+alone, as the output already holds a copy of them, those at 1 take the
+blurred value as is and only those in between are mixed. Pixels outside
+of weightSpan() are not looked at, and their blurred values need not
+have been computed.
+
+*/
+#define DEFINE_BLEND_ROW(name, T, store)                                      \
+  static void name(const Region *region,                                      \
+                   const void *source,                                        \
+                   void *target,                                              \
+                   const float *blurred,                                      \
+                   const int h)                                               \
+  {                                                                           \
+    int components = region->components;                                      \
+    const T *inPixel = (const T *) source;                                    \
+    T *outPixel = (T *) target;                                               \
+                                                                              \
+    int span[2];                                                              \
+    const int *runs;                                                          \
+    int runCount = weightRuns(region, h, span, &runs);                        \
+    int begin = span[0];                                                      \
+    int end = span[1];                                                        \
+                                                                              \
+    /* Runs of a shape are weighed at 1 throughout */                         \
+    if (blurShape != NULL)                                                    \
+    {                                                                         \
+      for (int run = 0; run < runCount; run++)                                \
+      {                                                                       \
+        int first = runs[2 * run] > begin ? runs[2 * run] : begin;            \
+        int last = runs[2 * run + 1] < end ? runs[2 * run + 1] : end;         \
+                                                                              \
+        for (int i = (first - region->x0) * components;                       \
+             i < (last - region->x0) * components; i++)                       \
+        {                                                                     \
+          outPixel[i] = store(blurred[i]);                                    \
+        }                                                                     \
+      }                                                                       \
+                                                                              \
+      return;                                                                 \
+    }                                                                         \
+                                                                              \
+    if (blurMask != NULL)                                                     \
+    {                                                                         \
+      const uint8_t *weight = blurMask + (size_t) h * region->width;          \
+                                                                              \
+      for (int w = begin; w < end; w++)                                       \
+      {                                                                       \
+        int i = (w - region->x0) * components;                                \
+                                                                              \
+        if (weight[w] == 0)                                                   \
+        {                                                                     \
+          continue;                                                           \
+        }                                                                     \
+                                                                              \
+        if (weight[w] == 255)                                                 \
+        {                                                                     \
+          for (int c = 0; c < components; c++)                                \
+          {                                                                   \
+            outPixel[i + c] = store(blurred[i + c]);                          \
+          }                                                                   \
+          continue;                                                           \
+        }                                                                     \
+                                                                              \
+        float v = weight[w] * (1.0f / 255);                                   \
+                                                                              \
+        for (int c = 0; c < components; c++)                                  \
+        {                                                                     \
+          outPixel[i + c] = store(inPixel[i + c] * (1 - v)                    \
+                                  + blurred[i + c] * v);                      \
+        }                                                                     \
+      }                                                                       \
+                                                                              \
+      return;                                                                 \
+    }                                                                         \
+                                                                              \
+    for (int w = begin; w < end; w++)                                         \
+    {                                                                         \
+      int i = (w - region->x0) * components;                                  \
+      double v = blendAreas != NULL                                           \
+        ? areasFalloff(w, h)                                                  \
+        : rampWeight(&region->ramp, w, h);                                    \
+                                                                              \
+      if (v <= 0)                                                             \
+      {                                                                       \
+        continue;                                                             \
+      }                                                                       \
+                                                                              \
+      if (v >= 1)                                                             \
+      {                                                                       \
+        for (int c = 0; c < components; c++)                                  \
+        {                                                                     \
+          outPixel[i + c] = store(blurred[i + c]);                            \
+        }                                                                     \
+        continue;                                                             \
+      }                                                                       \
+                                                                              \
+      for (int c = 0; c < components; c++)                                    \
+      {                                                                       \
+        outPixel[i + c] = store(inPixel[i + c] * (1 - v)                      \
+                                + blurred[i + c] * v);                        \
+      }                                                                       \
+    }                                                                         \
+  }
+
+DEFINE_BLEND_ROW(blendRowU8, uint8_t, saturate)
+DEFINE_BLEND_ROW(blendRowU16, uint16_t, saturate16)
+DEFINE_BLEND_ROW(blendRowF32, float, (float))
+
+static void (*const blendRowTyped[])(const Region *,
+                                     const void *,
+                                     void *,
+                                     const float *,
+                                     const int) = {
+  blendRowU8, blendRowU16, blendRowF32
+};
+
+
+/* Mix row /p h of the rectangle, from /p source into /p target, each
+   pointing at its pixel x0 */
+static void blendRowAt(const Region *region,
+                       const void *source,
+                       void *target,
+                       const float *blurred,
+                       const int h)
+{
+  blendRowTyped[region->type](region, source, target, blurred, h);
+}
+
+
+static void blendRow(const Region *region, const float *blurred, const int h)
+{
+  size_t offset = ((size_t) h * region->width + region->x0)
+    * region->components * pixelTypeSize(region->type);
+
+  blendRowAt(region,
+             (const uint8_t *) region->in + offset,
+             (uint8_t *) region->out + offset,
+             blurred, h);
+}
+
+
+/* As blendRow(), with the weight in 8 bits of fixed point */
+static void blendRowFixed(const Region *region, const uint8_t *blurred, const int h)
+{
+  int components = region->components;
+  size_t offset = ((size_t) h * region->width + region->x0) * components;
+  const uint8_t *inPixel = (const uint8_t *) region->in + offset;
+  uint8_t *outPixel = (uint8_t *) region->out + offset;
+
+  const uint8_t *weight = blurMask != NULL
+    ? blurMask + (size_t) h * region->width
+    : NULL;
+
+  int span[2];
+  const int *runs;
+  int runCount = weightRuns(region, h, span, &runs);
+  int begin = span[0];
+  int end = span[1];
+
+  /* Runs of a shape are weighed at 1 throughout */
+  if (blurShape != NULL)
+  {
+    for (int run = 0; run < runCount; run++)
+    {
+      int first = runs[2 * run] > begin ? runs[2 * run] : begin;
+      int last = runs[2 * run + 1] < end ? runs[2 * run + 1] : end;
+
+      if (first < last)
+      {
+        memcpy(outPixel + (first - region->x0) * components,
+               blurred + (first - region->x0) * components,
+               (size_t) (last - first) * components);
+      }
+    }
+
+    return;
+  }
+
+  for (int w = begin; w < end; w++)
+  {
+    int i = (w - region->x0) * components;
+    int v;
+
+    if (weight != NULL)
+    {
+      /* 0 to 255 onto 0 to 256 */
+      v = weight[w] + (weight[w] >> 7);
+    }
+    else if (blendAreas != NULL)
+    {
+      v = (int) (areasFalloff(w, h) * 256 + 0.5);
+    }
+    else
+    {
+      v = (int) (rampWeight(&region->ramp, w, h) * 256 + 0.5);
+    }
+
+    if (v == 0)
+    {
+      continue;
+    }
+
+    if (v == 256)
+    {
+      for (int c = 0; c < components; c++)
+      {
+        outPixel[i + c] = blurred[i + c];
+      }
+      continue;
+    }
+
+    for (int c = 0; c < components; c++)
+    {
+      outPixel[i + c] = (uint8_t) ((inPixel[i + c] * (256 - v) + blurred[i + c] * v + 128) >> 8);
+    }
+  }
+}
+
+
+typedef struct
+{
+  const Region *region;
+  const float *blurred;   // padded rectangle, or rectangle if pad is 0
+  int pad;                // of blurred
+} BlendContext;
+
+
+static void blendRows(void *context, const int first, const int last)
+{
+  BlendContext *blend = (BlendContext *) context;
+  const Region *region = blend->region;
+  int stride = (region->regionWidth + 2 * blend->pad) * region->components;
+
+  for (int r = first; r < last; r++)
+  {
+    blendRow(region,
+             blend->blurred + (size_t) (r + blend->pad) * stride
+                            + blend->pad * region->components,
+             region->y0 + r);
+  }
+}
+
+
+/* Mix a whole blurred rectangle into the output, on the shared pool */
+static void blendRegion(const Region *region, const float *blurred, const int pad)
+{
+  BlendContext blend = { region, blurred, pad };
+  parallelFor(region->regionHeight, blendRows, &blend);
+}
+
+
+typedef struct
+{
+  const Region *region;
+  const double *kernel;
+  const double *kernelIdentity;
+  int kernelSize;
+  bool failed;
+} DirectContext;
+
+
+static void convolveRows(void *context, const int first, const int last)
+{
+  DirectContext *direct = (DirectContext *) context;
+  const Region *region = direct->region;
+
+  int width = region->width;
+  int components = region->components;
+  const Ramp *ramp = &region->ramp;
+  int kernelSize = direct->kernelSize;
+
+  double *kernelInterpolated = (double *) malloc(kernelSize * kernelSize * sizeof(double));
+
+  if (kernelInterpolated == NULL)
+  {
+    direct->failed = true;
+    return;
+  }
+
+  int margin = (kernelSize - 1) / 2;
+
+  for (int h = first; h < last; h++)
+  {
+    size_t rowOffset = (size_t) h * width * components;
+
+    /* Rows are copied whole, unless already copied along with the other
+       areas' results; the identity kernel would reproduce them anyway */
+    if (blendAreas == NULL)
+    {
+      memcpy((uint8_t *) region->out + rowOffset,
+             (const uint8_t *) region->in + rowOffset,
+             (size_t) width * components);
+    }
+
+    if (h < region->y0 || h > region->y1)
+    {
+      continue;
+    }
+
+    /* Only convolute where weighed above 0, such that pixels outside of
+       the runs of the row are not visited at all */
+    int span[2];
+    const int *runs;
+    int runCount = weightRuns(region, h, span, &runs);
+
+    for (int run = 0; run < runCount; run++)
+    {
+      int runBegin = runs[2 * run] > span[0] ? runs[2 * run] : span[0];
+      int runEnd = runs[2 * run + 1] < span[1] ? runs[2 * run + 1] : span[1];
+
+      for (int w = runBegin; w < runEnd; w++)
+      {
+        const uint8_t *inPixel = (const uint8_t *) region->in + rowOffset + (size_t) w * components;
+        uint8_t *outPixel = (uint8_t *) region->out + rowOffset + (size_t) w * components;
+
+        double v = blurShape != NULL
+          ? 1
+          : blurMask != NULL
+          ? blurMask[(size_t) h * width + w] / 255.0
+          : blendAreas != NULL
+          ? areasFalloff(w, h)
+          : rampWeight(ramp, w, h);
+
+        if (v <= 0)
+        {
+          continue;
+        }
+
+        /* Whether the kernel lies entirely within the image */
+        bool interior = w >= margin && w < width - margin
+          && h >= margin && h < region->height - margin;
+
+        /* At full weight, the kernel is used as is */
+        const double *kernel = direct->kernel;
+
+        if (v < 1)
+        {
+          interpolate(
+            v,                        // weight
+            direct->kernelIdentity,   // a
+            direct->kernel,           // b
+            kernelInterpolated,       // c
+            kernelSize                // size
+          );
+
+          kernel = kernelInterpolated;
+        }
+
+        /* Mix each component separately */
+        for (int component = 0; component < components; component++)
+        {
+          int sum = 0;
+
+          for (int col = 0, i = 0; interior && col < kernelSize; col++)
+          {
+            for (int row = 0; row < kernelSize; row++)
+            {
+              /* Calculate kernel counterpart
+
+              The counterpart, referred to as "sample", originates at
+              the current pixel component and spans out in every direction
+              until a matrix of equivalent dimension is found. This matrix
+              is then multiplied with the kernel to produce the resuting pixel.
+
+              The origin between the kernel and sample position differ
+
+              kernel          sample
+               ___________     ___________
+              |k  |   |   |   |   |   |   |
+              |___|___|___|   |___|___|___|
+              |   |   |   |   |   |s  |   |
+              |___|___|___|   |___|___|___|
+              |   |   |   |   |   |   |   |
+              |___|___|___|   |___|___|___|
+
+              */
+
+              const uint8_t *samplePixel = inPixel
+                + (col - margin) * width * components
+                + (row - margin) * components;
+
+              sum += (int) (kernel[i] * samplePixel[component]);
+
+              i++;
+            }
+          }
+
+          /* Near the edge, samples beyond it are looked up per the
+             border mode instead */
+          for (int col = 0, i = 0; !interior && col < kernelSize; col++)
+          {
+            int y = borderIndex(h + col - margin, region->height);
+
+            for (int row = 0; row < kernelSize; row++)
+            {
+              int x = borderIndex(w + row - margin, width);
+              int sample = x < 0 || y < 0
+                ? borderValue
+                : inPixel[((y - h) * width + (x - w)) * components + component];
+
+              sum += (int) (kernel[i] * sample);
+
+              i++;
+            }
+          }
+
+          outPixel[component] = sum;
+        }
+      }
+    }
+  }
+
+  free(kernelInterpolated);
+}
+
+
+bool convolveInterpolated(const int width,
+                          const int height,
+                          const int minX,
+                          const int minY,
+                          const int maxX,
+                          const int maxY,
+                          const int components,
+                          const uint8_t *in,
+                          uint8_t *out,
+                          const double *kernel,
+                          const int kernelSize)
+{
+
+  /* Only deal with kernels of odd numbered dimensions */
+  if (kernelSize % 2 != 1)
+  {
+    return false;
+  }
+
+  Region region;
+  clipRegion(&region, width, height, minX, minY, maxX, maxY,
+             components, PIXEL_U8, in, out, 0);
+
+  const double *kernelIdentity = (const double *) cachedKernel(kernelSize, 0, KERNEL_IDENTITY);
+
+  if (kernelIdentity == NULL)
+  {
+    return false;
+  }
+
+  /* Bands of rows, on the shared pool */
+  DirectContext direct = { &region, kernel, kernelIdentity, kernelSize, false };
+  parallelFor(height, convolveRows, &direct);
+
+  return !direct.failed;
+}
+
+
+/* Values the dense engine sums at a time, which fit in registers */
+#define DENSE_STRIP 32
+
+
+/* Whether /p taps read the same backwards, as do those of computeKernel1D() */
+static bool tapsSymmetric(const float *taps, const int kernelSize)
+{
+  for (int t = 0; t < kernelSize / 2; t++)
+  {
+    if (taps[t] != taps[kernelSize - 1 - t])
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+
+/* Whether square /p taps are the same mirrored about their center row,
+   center column and diagonal, as are those of computeKernel() */
+static bool tapsRadial(const float *taps, const int kernelSize)
+{
+  int last = kernelSize - 1;
+
+  for (int r = 0; r < kernelSize; r++)
+  {
+    for (int c = 0; c < kernelSize; c++)
+    {
+      float tap = taps[r * kernelSize + c];
+
+      if (tap != taps[(last - r) * kernelSize + c]
+          || tap != taps[r * kernelSize + last - c]
+          || tap != taps[c * kernelSize + r])
+      {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+
+/* Weight shared by up to 8 taps of a radially symmetric kernel, and the
+   samples it weighs among the rows of foldedRow() */
+typedef struct
+{
+  float weight;
+  int count;                    // samples, 1 up to 4
+  int rows[4];                  // folded row, i.e. offset from center row
+  int columns[4];               // offset of sample in values
+} FoldedTap;
+
+
+static void addFolded(FoldedTap *tap, const int row, const int column, const int components)
+{
+  tap->rows[tap->count] = row;
+  tap->columns[tap->count] = column * components;
+  tap->count++;
+}
+
+
+/* Unique weights of radially symmetric /p taps, i.e. those a rows and b
+   columns off center with 0 <= a <= b <= margin, in /p out
+
+Its octants mirror each other, such that one holds all weights
+
+   _______
+  |\  |  /|
+  | \ | / |
+  |__\|/__|
+  |  /|\  |
+  | / | \ |
+  |/__|__\|
+
+Rows above and below the center are added up front, such that each
+weight takes up to 4 samples; at columns +-b of row a, and at columns
++-a of row b.
+
+*/
+static int foldTaps(FoldedTap *out,
+                    const float *taps,
+                    const int kernelSize,
+                    const int components)
+{
+  int margin = (kernelSize - 1) / 2;
+  int count = 0;
+
+  for (int a = 0; a <= margin; a++)
+  {
+    for (int b = a; b <= margin; b++)
+    {
+      FoldedTap *tap = &out[count++];
+      *tap = (FoldedTap) { taps[(margin + a) * kernelSize + margin + b],
+                           0, { 0 }, { 0 } };
+
+      addFolded(tap, a, margin - b, components);
+      if (b > 0)
+      {
+        addFolded(tap, a, margin + b, components);
+      }
+
+      if (a != b)
+      {
+        addFolded(tap, b, margin - a, components);
+        if (a > 0)
+        {
+          addFolded(tap, b, margin + a, components);
+        }
+      }
+    }
+  }
+
+  return count;
+}
+
+
+/* Values /p i up to /p i + /p n of a row of folded taps */
+static inline void foldedStrip(const float *const *rows,
+                               const FoldedTap *taps,
+                               const int tapCount,
+                               float *target,
+                               const int i,
+                               const int n)
+{
+  float sums[DENSE_STRIP] = { 0 };
+
+  for (int k = 0; k < tapCount; k++)
+  {
+    const FoldedTap *tap = &taps[k];
+    float weight = tap->weight;
+    const float *s0 = rows[tap->rows[0]] + tap->columns[0] + i;
+    const float *s1 = rows[tap->rows[1]] + tap->columns[1] + i;
+    const float *s2 = rows[tap->rows[2]] + tap->columns[2] + i;
+    const float *s3 = rows[tap->rows[3]] + tap->columns[3] + i;
+
+    switch (tap->count)
+    {
+      case 1:
+        for (int j = 0; j < n; j++)
+        {
+          sums[j] += weight * s0[j];
+        }
+        break;
+
+      case 2:
+        for (int j = 0; j < n; j++)
+        {
+          sums[j] += weight * (s0[j] + s1[j]);
+        }
+        break;
+
+      case 3:
+        for (int j = 0; j < n; j++)
+        {
+          sums[j] += weight * (s0[j] + s1[j] + s2[j]);
+        }
+        break;
+
+      default:
+        for (int j = 0; j < n; j++)
+        {
+          sums[j] += weight * ((s0[j] + s1[j]) + (s2[j] + s3[j]));
+        }
+        break;
+    }
+  }
+
+  for (int j = 0; j < n; j++)
+  {
+    target[i + j] = sums[j];
+  }
+}
+
+
+/* Values /p first up to /p count of a row of the dense engine, from its
+   /p rows folded about the center, multiplying once per unique weight
+   rather than once per tap */
+static void foldedRow(const float *const *rows,
+                      const FoldedTap *taps,
+                      const int tapCount,
+                      float *target,
+                      const int first,
+                      const int count)
+{
+  int i = first;
+
+  for (; i + DENSE_STRIP <= count; i += DENSE_STRIP)
+  {
+    foldedStrip(rows, taps, tapCount, target, i, DENSE_STRIP);
+  }
+
+  if (i < count)
+  {
+    foldedStrip(rows, taps, tapCount, target, i, count - i);
+  }
+}
+
+
+typedef struct
+{
+  const Region *region;
+  const float *taps;
+  int kernelSize;
+  const FoldedTap *folded;      // unique weights, if taps are radial
+  int foldedCount;              // 0 if not
+  Tiling tiling;
+  bool failed;
+} DenseContext;
+
+
+/* Values /p first up to /p count of a row of the dense engine, for one
+   of the kernel sizes and component counts nearly all jobs use
+
+Each is defined once per combination by the macro below, such that the
+tap loops have constant bounds and offsets and the compiler unrolls
+them. Samples are summed a strip of DENSE_STRIP at a time, which fits in
+registers, rather than going over a row-long accumulator once per tap;
+
+  strip   [s0 s1 .. s31] += weight * source[col * C ..]   for every tap
+
+Taps are summed in the same order as the generic loop, so results are
+identical.
+
+*/
+#define DEFINE_DENSE_ROW(K, C)                                                \
+  static void denseRow##K##x##C(const float *padded,                          \
+                                const size_t paddedStride,                    \
+                                const float *taps,                            \
+                                float *target,                                \
+                                const int first,                              \
+                                const int count)                              \
+  {                                                                           \
+    float weights[K * K];                                                     \
+                                                                              \
+    for (int t = 0; t < K * K; t++)                                           \
+    {                                                                         \
+      weights[t] = taps[t];                                                   \
+    }                                                                         \
+                                                                              \
+    int i = first;                                                            \
+                                                                              \
+    for (; i + DENSE_STRIP <= count; i += DENSE_STRIP)                        \
+    {                                                                         \
+      float sums[DENSE_STRIP] = { 0 };                                        \
+                                                                              \
+      for (int row = 0; row < K; row++)                                       \
+      {                                                                       \
+        const float *line = padded + row * paddedStride + i;                  \
+                                                                              \
+        for (int col = 0; col < K; col++)                                     \
+        {                                                                     \
+          float weight = weights[row * K + col];                              \
+          const float *source = line + col * C;                               \
+                                                                              \
+          for (int j = 0; j < DENSE_STRIP; j++)                               \
+          {                                                                   \
+            sums[j] += weight * source[j];                                    \
+          }                                                                   \
+        }                                                                     \
+      }                                                                       \
+                                                                              \
+      for (int j = 0; j < DENSE_STRIP; j++)                                   \
+      {                                                                       \
+        target[i + j] = sums[j];                                              \
+      }                                                                       \
+    }                                                                         \
+                                                                              \
+    for (; i < count; i++)                                                    \
+    {                                                                         \
+      float sum = 0;                                                          \
+                                                                              \
+      for (int row = 0; row < K; row++)                                       \
+      {                                                                       \
+        const float *source = padded + row * paddedStride + i;                \
+                                                                              \
+        for (int col = 0; col < K; col++)                                     \
+        {                                                                     \
+          sum += weights[row * K + col] * source[col * C];                    \
+        }                                                                     \
+      }                                                                       \
+                                                                              \
+      target[i] = sum;                                                        \
+    }                                                                         \
+  }
+
+DEFINE_DENSE_ROW(3, 1)
+DEFINE_DENSE_ROW(3, 3)
+DEFINE_DENSE_ROW(3, 4)
+DEFINE_DENSE_ROW(5, 1)
+DEFINE_DENSE_ROW(5, 3)
+DEFINE_DENSE_ROW(5, 4)
+DEFINE_DENSE_ROW(7, 1)
+DEFINE_DENSE_ROW(7, 3)
+DEFINE_DENSE_ROW(7, 4)
+DEFINE_DENSE_ROW(9, 1)
+DEFINE_DENSE_ROW(9, 3)
+DEFINE_DENSE_ROW(9, 4)
+
+typedef void (*DenseRow)(const float *, const size_t, const float *, float *,
+                         const int, const int);
+
+static const DenseRow denseRows[4][3] = {
+  { denseRow3x1, denseRow3x3, denseRow3x4 },
+  { denseRow5x1, denseRow5x3, denseRow5x4 },
+  { denseRow7x1, denseRow7x3, denseRow7x4 },
+  { denseRow9x1, denseRow9x3, denseRow9x4 }
+};
+
+
+/* Specialised row for /p kernelSize and /p components, or NULL for the
+   generic loop */
+static DenseRow selectDenseRow(const int kernelSize, const int components)
+{
+  int column = components == 1 ? 0 : components == 3 ? 1 : components == 4 ? 2 : -1;
+
+  if (kernelSize < 3 || kernelSize > 9 || kernelSize % 2 != 1 || column < 0)
+  {
+    return NULL;
+  }
+
+  return denseRows[(kernelSize - 3) / 2][column];
+}
+
+
+/* All kernelSize * kernelSize taps of tiles /p first up to /p last, each
+   accumulated a whole row of the tile at a time, skipping pixels the blur
+   is weighed at 0 at */
+static void denseTiles(void *context, const int first, const int last)
+{
+  DenseContext *dense = (DenseContext *) context;
+  const Region *region = dense->region;
+  const float *taps = dense->taps;
+  int kernelSize = dense->kernelSize;
+  int components = region->components;
+  int margin = (kernelSize - 1) / 2;
+  DenseRow denseRow = selectDenseRow(kernelSize, components);
+
+  int size = dense->tiling.size;
+  size_t paddedStride = (size_t) (size + 2 * region->pad) * components;
+  size_t paddedSize = (size + 2 * region->pad) * paddedStride;
+
+  float *padded = (float *) malloc(paddedSize * sizeof(float));
+  float *accumulator = (float *) malloc(size * components * sizeof(float));
+
+  /* Rows above and below the center of the kernel, added pairwise */
+  float *folded = (float *) malloc((margin * paddedStride + 1) * sizeof(float));
+  const float **rows = (const float **) malloc((margin + 1) * sizeof(float *));
+
+  if (padded == NULL || accumulator == NULL || folded == NULL || rows == NULL)
+  {
+    free(padded);
+    free(accumulator);
+    free(folded);
+    free(rows);
+    dense->failed = true;
+    return;
+  }
+
+  for (int index = first; index < last; index++)
+  {
+    Region tile;
+    selectTile(&tile, region, &dense->tiling, index);
+
+    if (tileMasked(&tile))
+    {
+      continue;
+    }
+
+    PaddedContext copy = { &tile, padded, NULL };
+    copyPaddedRows(&copy, 0, tile.paddedHeight);
+
+    for (int r = 0; r < tile.regionHeight; r++)
+    {
+      int begin, end;
+      weightSpan(&tile, tile.y0 + r, &begin, &end);
+
+      if (begin == end)
+      {
+        continue;
+      }
+
+      /* Values of the span, within the row of the tile */
+      int spanFirst = (begin - tile.x0) * components;
+      int spanCount = (end - tile.x0) * components;
+
+      if (dense->foldedCount > 0)
+      {
+        const float *center = padded + (size_t) (r + margin) * tile.paddedStride;
+        rows[0] = center;
+
+        for (int a = 1; a <= margin; a++)
+        {
+          const float *above = center - (size_t) a * tile.paddedStride;
+          const float *below = center + (size_t) a * tile.paddedStride;
+          float *target = folded + (size_t) (a - 1) * tile.paddedStride;
+
+          for (int i = spanFirst; i < spanCount + 2 * margin * components; i++)
+          {
+            target[i] = above[i] + below[i];
+          }
+
+          rows[a] = target;
+        }
+
+        foldedRow(rows, dense->folded, dense->foldedCount, accumulator,
+                  spanFirst, spanCount);
+        blendRow(&tile, accumulator, tile.y0 + r);
+        continue;
+      }
+
+      if (denseRow != NULL)
+      {
+        denseRow(padded + (size_t) r * tile.paddedStride, tile.paddedStride,
+                 taps, accumulator, spanFirst, spanCount);
+        blendRow(&tile, accumulator, tile.y0 + r);
+        continue;
+      }
+
+      for (int i = spanFirst; i < spanCount; i++)
+      {
+        accumulator[i] = 0;
+      }
+
+      for (int row = 0, t = 0; row < kernelSize; row++)
+      {
+        const float *line = padded + (size_t) (r + row) * tile.paddedStride;
+
+        for (int col = 0; col < kernelSize; col++, t++)
+        {
+          const float *source = line + col * components;
+
+          for (int i = spanFirst; i < spanCount; i++)
+          {
+            accumulator[i] += taps[t] * source[i];
+          }
+        }
+      }
+
+      blendRow(&tile, accumulator, tile.y0 + r);
+    }
+  }
+
+  free(padded);
+  free(accumulator);
+  free(folded);
+  free(rows);
+}
+
+
+static bool convolveTyped(const int width,
+                          const int height,
+                          const int minX,
+                          const int minY,
+                          const int maxX,
+                          const int maxY,
+                          const int components,
+                          const PixelType type,
+                          const void *in,
+                          void *out,
+                          const double *kernel,
+                          const int kernelSize)
+{
+  if (kernelSize % 2 != 1)
+  {
+    return false;
+  }
+
+  int margin = (kernelSize - 1) / 2;
+
+  copyUntouched(in, out, width, height, components * pixelTypeSize(type));
+
+  /* Convolution is linear, so mixing the kernel with its identity by the
+     falloff of each pixel equals mixing the source with the rectangle
+     blurred once by the kernel
+
+       lerp(identity, kernel, v) * in  =  lerp(in, kernel * in, v)
+
+  */
+  Region region;
+  if (!clipRegion(&region, width, height, minX, minY, maxX, maxY,
+                  components, type, in, out, margin))
+  {
+    return true;
+  }
+
+  float *taps = (float *) malloc(kernelSize * kernelSize * sizeof(float));
+
+  if (taps == NULL)
+  {
+    return false;
+  }
+
+  for (int i = 0; i < kernelSize * kernelSize; i++)
+  {
+    taps[i] = (float) kernel[i];
+  }
+
+  /* Gaussians are radially symmetric, which kernels of the caller need
+     not be; a 3x3 kernel has too few taps to pay for folding its rows */
+  FoldedTap *folded = (FoldedTap *) malloc((margin + 1) * (margin + 2) / 2 * sizeof(FoldedTap));
+
+  if (folded == NULL)
+  {
+    free(taps);
+    return false;
+  }
+
+  int foldedCount = kernelSize > 3 && tapsRadial(taps, kernelSize)
+    ? foldTaps(folded, taps, kernelSize, components)
+    : 0;
+
+  DenseContext dense = { &region, taps, kernelSize, folded, foldedCount,
+                         { 0, 0, 0 }, false };
+  computeTiling(&dense.tiling, &region,
+                computeTileSize(components * sizeof(float), margin));
+  parallelFor(dense.tiling.count, denseTiles, &dense);
+
+  free(taps);
+  free(folded);
+
+  return !dense.failed;
+}
+
+
+bool convolve(const int width,
+              const int height,
+              const int minX,
+              const int minY,
+              const int maxX,
+              const int maxY,
+              const int components,
+              const uint8_t *in,
+              uint8_t *out,
+              const double *kernel,
+              const int kernelSize)
+{
+  return convolveTyped(width, height, minX, minY, maxX, maxY,
+                       components, PIXEL_U8, in, out, kernel, kernelSize);
+}
+
+
+/* Horizontal pass over values /p first up to /p count of a padded line,
+   into /p target; folded about the center tap if /p symmetric
+
+This and filterColumns() are shared by every engine that promises the
+output of BLUR_SEPARABLE, such that all of them add their taps in the
+same order and round alike.
+
+*/
+static void filterValues(const float *taps,
+                         const int kernelSize,
+                         const bool symmetric,
+                         const int components,
+                         const float *line,
+                         float *target,
+                         const int first,
+                         const int count)
+{
+  int margin = (kernelSize - 1) / 2;
+
+  if (symmetric)
+  {
+    const float *center = line + margin * components;
+
+    for (int i = first; i < count; i++)
+    {
+      float sum = taps[margin] * center[i];
+
+      for (int t = 0; t < margin; t++)
+      {
+        sum += taps[t] * (line[i + t * components]
+                          + line[i + (kernelSize - 1 - t) * components]);
+      }
+
+      target[i] = sum;
+    }
+
+    return;
+  }
+
+  for (int i = first; i < count; i++)
+  {
+    float sum = 0;
+
+    for (int t = 0; t < kernelSize; t++)
+    {
+      sum += taps[t] * line[i + t * components];
+    }
+
+    target[i] = sum;
+  }
+}
+
+
+/* Vertical pass over values /p first up to /p count of /p kernelSize
+   horizontally filtered /p rows, top to bottom, into /p target */
+static void filterColumns(const float *taps,
+                          const int kernelSize,
+                          const bool symmetric,
+                          const float *const *rows,
+                          float *target,
+                          const int first,
+                          const int count)
+{
+  int margin = (kernelSize - 1) / 2;
+
+  if (symmetric)
+  {
+    const float *center = rows[margin];
+
+    for (int i = first; i < count; i++)
+    {
+      target[i] = taps[margin] * center[i];
+    }
+
+    for (int t = 0; t < margin; t++)
+    {
+      const float *above = rows[t];
+      const float *below = rows[kernelSize - 1 - t];
+
+      for (int i = first; i < count; i++)
+      {
+        target[i] += taps[t] * (above[i] + below[i]);
+      }
+    }
+
+    return;
+  }
+
+  for (int i = first; i < count; i++)
+  {
+    target[i] = 0;
+  }
+
+  for (int t = 0; t < kernelSize; t++)
+  {
+    const float *source = rows[t];
+
+    for (int i = first; i < count; i++)
+    {
+      target[i] += taps[t] * source[i];
+    }
+  }
+}
+
+
+typedef struct
+{
+  const Region *region;
+  const float *taps;
+  int kernelSize;
+  bool symmetric;               // taps read the same backwards
+  Tiling tiling;
+  bool failed;
+} SeparableContext;
+
+
+/* Horizontal, then vertical pass of tiles /p first up to /p last
+
+Each tile is first copied into /p padded, along with /p margin pixels on
+every side clamped to the nearest edge pixel, such that the tap loops
+never have to check their bounds.
+
+*/
+static void separableTiles(void *context, const int first, const int last)
+{
+  SeparableContext *separable = (SeparableContext *) context;
+  const Region *region = separable->region;
+  const float *taps = separable->taps;
+  int kernelSize = separable->kernelSize;
+  int margin = (kernelSize - 1) / 2;
+  int components = region->components;
+
+  int size = separable->tiling.size;
+  size_t paddedSize = (size_t) (size + 2 * region->pad) * (size + 2 * region->pad) * components;
+  size_t horizontalSize = (size_t) (size + 2 * region->pad) * size * components;
+
+  float *padded = (float *) malloc(paddedSize * sizeof(float));
+  float *horizontal = (float *) malloc(horizontalSize * sizeof(float));
+  float *accumulator = (float *) malloc(size * components * sizeof(float));
+  int *spans = (int *) malloc(2 * size * sizeof(int));
+  const float **rows = (const float **) malloc(kernelSize * sizeof(float *));
+
+  if (padded == NULL || horizontal == NULL || accumulator == NULL
+      || spans == NULL || rows == NULL)
+  {
+    free(padded);
+    free(horizontal);
+    free(accumulator);
+    free(spans);
+    free(rows);
+    separable->failed = true;
+    return;
+  }
+
+  for (int index = first; index < last; index++)
+  {
+    Region tile;
+    selectTile(&tile, region, &separable->tiling, index);
+
+    if (!tileSpans(&tile, spans))
+    {
+      continue;
+    }
+
+    PaddedContext copy = { &tile, padded, NULL };
+    copyPaddedRows(&copy, 0, tile.paddedHeight);
+
+    int stride = tile.stride;
+
+    /* Horizontal pass, of only the values the vertical pass reads; those
+       of the spans of the rows up to kernelSize below */
+    for (int r = 0; r < tile.paddedHeight; r++)
+    {
+      const float *line = padded + (size_t) r * tile.paddedStride;
+      float *target = horizontal + (size_t) r * stride;
+
+      int spanFirst, spanCount;
+      spanUnion(spans, tile.regionHeight, r - 2 * margin, r + 1,
+                &spanFirst, &spanCount);
+
+      filterValues(taps, kernelSize, separable->symmetric, components,
+                   line, target, spanFirst, spanCount);
+    }
+
+    /* Vertical pass, followed by mixing with the source */
+    for (int r = 0; r < tile.regionHeight; r++)
+    {
+      const float *top = horizontal + (size_t) r * stride;
+      int spanFirst = spans[2 * r];
+      int spanCount = spans[2 * r + 1];
+
+      if (spanFirst == spanCount)
+      {
+        continue;
+      }
+
+      for (int t = 0; t < kernelSize; t++)
+      {
+        rows[t] = top + (size_t) t * stride;
+      }
+
+      filterColumns(taps, kernelSize, separable->symmetric, rows,
+                    accumulator, spanFirst, spanCount);
+
+      blendRow(&tile, accumulator, tile.y0 + r);
+    }
+  }
+
+  free(padded);
+  free(horizontal);
+  free(accumulator);
+  free(spans);
+  free(rows);
+}
+
+
+static bool convolveSeparableTyped(const int width,
+                                   const int height,
+                                   const int minX,
+                                   const int minY,
+                                   const int maxX,
+                                   const int maxY,
+                                   const int components,
+                                   const PixelType type,
+                                   const void *in,
+                                   void *out,
+                                   const double *kernel,
+                                   const int kernelSize)
+{
+  if (kernelSize % 2 != 1)
+  {
+    return false;
+  }
+
+  int margin = (kernelSize - 1) / 2;
+
+  copyUntouched(in, out, width, height, components * pixelTypeSize(type));
+
+  /* The vertical pass reads /p margin rows above and below each tile
+
+     rowFirst  ____________
+              |  ________  |   <- margin
+              | |        | |
+              | |  tile  | |
+              | |________| |
+     rowLast  |____________|   <- margin
+
+  */
+  Region region;
+  if (!clipRegion(&region, width, height, minX, minY, maxX, maxY,
+                  components, type, in, out, margin))
+  {
+    return true;
+  }
+
+  float *taps = (float *) malloc(kernelSize * sizeof(float));
+
+  if (taps == NULL)
+  {
+    return false;
+  }
+
+  for (int i = 0; i < kernelSize; i++)
+  {
+    taps[i] = (float) kernel[i];
+  }
+
+  SeparableContext separable = { &region, taps, kernelSize,
+                                 tapsSymmetric(taps, kernelSize),
+                                 { 0, 0, 0 }, false };
+  computeTiling(&separable.tiling, &region,
+                computeTileSize(2 * components * sizeof(float), margin));
+  parallelFor(separable.tiling.count, separableTiles, &separable);
+
+  free(taps);
+
+  return !separable.failed;
+}
+
+
+bool convolveSeparable(const int width,
+                       const int height,
+                       const int minX,
+                       const int minY,
+                       const int maxX,
+                       const int maxY,
+                       const int components,
+                       const uint8_t *in,
+                       uint8_t *out,
+                       const double *kernel,
+                       const int kernelSize)
+{
+  return convolveSeparableTyped(width, height, minX, minY, maxX, maxY,
+                                components, PIXEL_U8, in, out, kernel, kernelSize);
+}
+
+
+/* Widths of /p n box blurs whose cascade approximates a gaussian
+
+Reference:
+ - http://blog.ivank.net/fastest-gaussian-blur.html
+ - http://www.peterkovesi.com/papers/FastGaussianSmoothing.pdf
+
+*/
+static void computeBoxSizes(int *out, const double sigma, const int n)
+{
+  /* Ideal width, if all boxes were the same */
+  int lower = (int) floor(sqrt(12 * sigma * sigma / n + 1));
+  lower -= lower % 2 == 0 ? 1 : 0;
+  int upper = lower + 2;
+
+  /* Number of boxes of the lower width, such that variances add up */
+  double ideal = (12 * sigma * sigma
+                  - n * lower * lower
+                  - 4 * n * lower
+                  - 3 * n) / (-4.0 * lower - 4);
+  int count = (int) floor(ideal + 0.5);
+
+  for (int i = 0; i < n; i++)
+  {
+    out[i] = i < count ? lower : upper;
+  }
+}
+
+
+/* Running sum along /p count elements spaced /p step apart
+
+Samples beyond either end are clamped to the nearest element; the caller
+pads its data such that these never reach the result it reads.
+
+*/
+static void boxPass(const float *in,
+                    float *out,
+                    const int count,
+                    const int step,
+                    const int radius)
+{
+  double scale = 1.0 / (2 * radius + 1);
+  double sum = 0;
+
+  for (int i = -radius; i <= radius; i++)
+  {
+    int j = i < 0 ? 0 : i >= count ? count - 1 : i;
+    sum += in[j * step];
+  }
+
+  for (int i = 0; i < count; i++)
+  {
+    out[i * step] = (float) (sum * scale);
+
+    int enter = i + radius + 1;
+    int leave = i - radius;
+    enter = enter >= count ? count - 1 : enter;
+    leave = leave < 0 ? 0 : leave;
+
+    sum += in[enter * step] - in[leave * step];
+  }
+}
+
+
+typedef struct
+{
+  const Region *region;
+  const float *source;
+  float *target;
+  int radius;
+  bool failed;
+} BoxContext;
+
+
+static void boxRows(void *context, const int first, const int last)
+{
+  BoxContext *box = (BoxContext *) context;
+  const Region *region = box->region;
+  int components = region->components;
+  int stride = region->paddedStride;
+
+  for (int r = first; r < last; r++)
+  {
+    for (int c = 0; c < components; c++)
+    {
+      boxPass(box->source + (size_t) r * stride + c,
+              box->target + (size_t) r * stride + c,
+              region->paddedWidth,
+              components,
+              box->radius);
+    }
+  }
+}
+
+
+/* Vertical pass over values /p first up to /p last of every row
+
+Rather than walking down each column, a row of running sums is kept in
+/p window and rows are added and subtracted as it slides. Bands split
+the row rather than the columns, such that every sum is accumulated in
+the same order regardless of the number of bands.
+
+*/
+static void boxColumns(void *context, const int first, const int last)
+{
+  BoxContext *box = (BoxContext *) context;
+  const Region *region = box->region;
+  int stride = region->paddedStride;
+  int paddedHeight = region->paddedHeight;
+  int radius = box->radius;
+  int count = last - first;
+  double scale = 1.0 / (2 * radius + 1);
+
+  const float *source = box->source + first;
+  float *target = box->target + first;
+
+  double *window = (double *) malloc(count * sizeof(double));
+
+  if (window == NULL)
+  {
+    box->failed = true;
+    return;
+  }
+
+  for (int i = 0; i < count; i++)
+  {
+    window[i] = 0;
+  }
+
+  for (int r = -radius; r <= radius; r++)
+  {
+    const float *row = source + (size_t) (r < 0 ? 0 : r >= paddedHeight ? paddedHeight - 1 : r) * stride;
+
+    for (int i = 0; i < count; i++)
+    {
+      window[i] += row[i];
+    }
+  }
+
+  for (int r = 0; r < paddedHeight; r++)
+  {
+    float *row = target + (size_t) r * stride;
+
+    for (int i = 0; i < count; i++)
+    {
+      row[i] = (float) (window[i] * scale);
+    }
+
+    int enter = r + radius + 1;
+    int leave = r - radius;
+    enter = enter >= paddedHeight ? paddedHeight - 1 : enter;
+    leave = leave < 0 ? 0 : leave;
+
+    const float *entering = source + (size_t) enter * stride;
+    const float *leaving = source + (size_t) leave * stride;
+
+    for (int i = 0; i < count; i++)
+    {
+      window[i] += entering[i] - leaving[i];
+    }
+  }
+
+  free(window);
+}
+
+
+static bool boxBlurTyped(const int width,
+                         const int height,
+                         const int minX,
+                         const int minY,
+                         const int maxX,
+                         const int maxY,
+                         const int components,
+                         const PixelType type,
+                         const void *in,
+                         void *out,
+                         const double sigma)
+{
+  copyUntouched(in, out, width, height, components * pixelTypeSize(type));
+
+  int sizes[3];
+  computeBoxSizes(sizes, sigma, 3);
+
+  /* Each pass widens the footprint by its radius */
+  int pad = 0;
+  for (int i = 0; i < 3; i++)
+  {
+    pad += (sizes[i] - 1) / 2;
+  }
+
+  Region region;
+  if (!clipRegion(&region, width, height, minX, minY, maxX, maxY,
+                  components, type, in, out, pad))
+  {
+    return true;
+  }
+
+  size_t size = (size_t) region.paddedHeight * region.paddedStride;
+  float *front = (float *) malloc(size * sizeof(float));
+  float *back = (float *) malloc(size * sizeof(float));
+
+  if (front == NULL || back == NULL)
+  {
+    free(front);
+    free(back);
+    return false;
+  }
+
+  copyPadded(&region, front);
+
+  /* Horizontal passes, then vertical passes, ping-ponging between
+     front and back */
+  BoxContext box = { &region, NULL, NULL, 0, false };
+
+  for (int pass = 0; pass < 6; pass++)
+  {
+    box.source = front;
+    box.target = back;
+    box.radius = (sizes[pass % 3] - 1) / 2;
+
+    if (pass < 3)
+    {
+      parallelFor(region.paddedHeight, boxRows, &box);
+    }
+    else
+    {
+      parallelFor(region.paddedStride, boxColumns, &box);
+    }
+
+    float *swap = front;
+    front = back;
+    back = swap;
+  }
+
+  blendRegion(&region, front, pad);
+
+  free(front);
+  free(back);
+
+  return !box.failed;
+}
+
+
+bool boxBlur(const int width,
+             const int height,
+             const int minX,
+             const int minY,
+             const int maxX,
+             const int maxY,
+             const int components,
+             const uint8_t *in,
+             uint8_t *out,
+             const double sigma)
+{
+  return boxBlurTyped(width, height, minX, minY, maxX, maxY,
+                      components, PIXEL_U8, in, out, sigma);
+}
+
+
+/* Coefficients of the recursive gaussian, normalised by b0
+
+Reference:
+ - Young & van Vliet, "Recursive implementation of the Gaussian filter",
+   Signal Processing 44, 1995
+
+*/
+static void computeRecursive(double *out, const double sigma)
+{
+  double s = sigma > 0.5 ? sigma : 0.5;
+  double q = s >= 2.5
+    ? 0.98711 * s - 0.96330
+    : 3.97156 - 4.14554 * sqrt(1 - 0.26891 * s);
+
+  double b0 = 1.57825 + 2.44413 * q + 1.4281 * q * q + 0.422205 * q * q * q;
+  double b1 = 2.44413 * q + 2.85619 * q * q + 1.26661 * q * q * q;
+  double b2 = -(1.4281 * q * q + 1.26661 * q * q * q);
+  double b3 = 0.422205 * q * q * q;
+
+  out[1] = b1 / b0;
+  out[2] = b2 / b0;
+  out[3] = b3 / b0;
+  out[0] = 1 - (out[1] + out[2] + out[3]);
+}
+
+
+/* Causal and anti-causal recursion along /p count samples spaced /p step
+
+Each sample consists of /p lanes adjacent and independent values, such
+as the components of a pixel or every component of a row. Beyond either
+end, the signal is taken to continue as its first and last sample
+respectively; /p edge holds /p lanes values of scratch.
+
+*/
+static void recursivePass(const float *in,
+                          float *out,
+                          float *edge,
+                          const int count,
+                          const int step,
+                          const int lanes,
+                          const double *coef)
+{
+  /* Forward */
+  for (int n = 0; n < count; n++)
+  {
+    const float *x = in + (size_t) n * step;
+    const float *y1 = n >= 1 ? out + (size_t) (n - 1) * step : in;
+    const float *y2 = n >= 2 ? out + (size_t) (n - 2) * step : in;
+    const float *y3 = n >= 3 ? out + (size_t) (n - 3) * step : in;
+    float *y = out + (size_t) n * step;
+
+    for (int i = 0; i < lanes; i++)
+    {
+      y[i] = (float) (coef[0] * x[i]
+                      + coef[1] * y1[i]
+                      + coef[2] * y2[i]
+                      + coef[3] * y3[i]);
+    }
+  }
+
+  /* Backward, in-place */
+  const float *last = out + (size_t) (count - 1) * step;
+  for (int i = 0; i < lanes; i++)
+  {
+    edge[i] = last[i];
+  }
+
+  for (int n = count - 1; n >= 0; n--)
+  {
+    const float *y1 = n + 1 < count ? out + (size_t) (n + 1) * step : edge;
+    const float *y2 = n + 2 < count ? out + (size_t) (n + 2) * step : edge;
+    const float *y3 = n + 3 < count ? out + (size_t) (n + 3) * step : edge;
+    float *y = out + (size_t) n * step;
+
+    for (int i = 0; i < lanes; i++)
+    {
+      y[i] = (float) (coef[0] * y[i]
+                      + coef[1] * y1[i]
+                      + coef[2] * y2[i]
+                      + coef[3] * y3[i]);
+    }
+  }
+}
+
+
+typedef struct
+{
+  const Region *region;
+  const double *coef;
+  const float *source;
+  float *target;
+  bool failed;
+} RecursiveContext;
+
+
+/* Along each row, one lane per component */
+static void recursiveRows(void *context, const int first, const int last)
+{
+  RecursiveContext *recursive = (RecursiveContext *) context;
+  const Region *region = recursive->region;
+  int components = region->components;
+  int stride = region->paddedStride;
+
+  float *edge = (float *) malloc(components * sizeof(float));
+
+  if (edge == NULL)
+  {
+    recursive->failed = true;
+    return;
+  }
+
+  for (int r = first; r < last; r++)
+  {
+    recursivePass(recursive->source + (size_t) r * stride,
+                  recursive->target + (size_t) r * stride,
+                  edge,
+                  region->paddedWidth,
+                  components,
+                  components,
+                  recursive->coef);
+  }
+
+  free(edge);
+}
+
+
+/* Down all columns at once, one lane per value /p first up to /p last */
+static void recursiveColumns(void *context, const int first, const int last)
+{
+  RecursiveContext *recursive = (RecursiveContext *) context;
+  const Region *region = recursive->region;
+
+  float *edge = (float *) malloc((last - first) * sizeof(float));
+
+  if (edge == NULL)
+  {
+    recursive->failed = true;
+    return;
+  }
+
+  recursivePass(recursive->source + first,
+                recursive->target + first,
+                edge,
+                region->paddedHeight,
+                region->paddedStride,
+                last - first,
+                recursive->coef);
+
+  free(edge);
+}
+
+
+static bool iirBlurTyped(const int width,
+                         const int height,
+                         const int minX,
+                         const int minY,
+                         const int maxX,
+                         const int maxY,
+                         const int components,
+                         const PixelType type,
+                         const void *in,
+                         void *out,
+                         const double sigma)
+{
+  copyUntouched(in, out, width, height, components * pixelTypeSize(type));
+
+  double coef[4];
+  computeRecursive(coef, sigma);
+
+  /* The response never quite reaches zero; beyond 4 sigma it is below
+     what 8 bits can represent */
+  int pad = (int) ceil(4 * sigma);
+
+  Region region;
+  if (!clipRegion(&region, width, height, minX, minY, maxX, maxY,
+                  components, type, in, out, pad))
+  {
+    return true;
+  }
+
+  size_t size = (size_t) region.paddedHeight * region.paddedStride;
+  float *source = (float *) malloc(size * sizeof(float));
+  float *filtered = (float *) malloc(size * sizeof(float));
+
+  if (source == NULL || filtered == NULL)
+  {
+    free(source);
+    free(filtered);
+    return false;
+  }
+
+  copyPadded(&region, source);
+
+  RecursiveContext recursive = { &region, coef, source, filtered, false };
+  parallelFor(region.paddedHeight, recursiveRows, &recursive);
+
+  recursive.source = filtered;
+  recursive.target = source;
+  parallelFor(region.paddedStride, recursiveColumns, &recursive);
+
+  blendRegion(&region, source, pad);
+
+  free(source);
+  free(filtered);
+
+  return !recursive.failed;
+}
+
+
+bool iirBlur(const int width,
+             const int height,
+             const int minX,
+             const int minY,
+             const int maxX,
+             const int maxY,
+             const int components,
+             const uint8_t *in,
+             uint8_t *out,
+             const double sigma)
+{
+  return iirBlurTyped(width, height, minX, minY, maxX, maxY,
+                      components, PIXEL_U8, in, out, sigma);
+}
+
+
+/* Burt & Adelson's 5-tap binomial; a gaussian of variance 1 */
+static const float binomial[5] = {
+  1.0f / 16, 4.0f / 16, 6.0f / 16, 4.0f / 16, 1.0f / 16
+};
+
+
+typedef struct
+{
+  const float *source;
+  float *target;
+  int width;              // of source, in pixels
+  int height;             //
+  int targetWidth;        //
+  int targetHeight;       //
+  int components;
+} LevelContext;
+
+
+static int clampIndex(const int i, const int n)
+{
+  return i < 0 ? 0 : i < n ? i : n - 1;
+}
+
+
+/* Filter and halve each row /p first up to /p last */
+static void reduceRows(void *context, const int first, const int last)
+{
+  LevelContext *level = (LevelContext *) context;
+  int components = level->components;
+
+  for (int r = first; r < last; r++)
+  {
+    const float *source = level->source + (size_t) r * level->width * components;
+    float *target = level->target + (size_t) r * level->targetWidth * components;
+
+    for (int x = 0; x < level->targetWidth; x++)
+    {
+      for (int c = 0; c < components; c++)
+      {
+        float sum = 0;
+
+        for (int t = 0; t < 5; t++)
+        {
+          sum += binomial[t]
+            * source[clampIndex(2 * x + t - 2, level->width) * components + c];
+        }
+
+        target[x * components + c] = sum;
+      }
+    }
+  }
+}
+
+
+/* Target rows /p first up to /p last, each filtered from the source rows
+   about twice its index */
+static void reduceColumns(void *context, const int first, const int last)
+{
+  LevelContext *level = (LevelContext *) context;
+  int stride = level->width * level->components;
+
+  for (int r = first; r < last; r++)
+  {
+    float *target = level->target + (size_t) r * stride;
+
+    for (int i = 0; i < stride; i++)
+    {
+      target[i] = 0;
+    }
+
+    for (int t = 0; t < 5; t++)
+    {
+      const float *source = level->source
+        + (size_t) clampIndex(2 * r + t - 2, level->height) * stride;
+
+      for (int i = 0; i < stride; i++)
+      {
+        target[i] += binomial[t] * source[i];
+      }
+    }
+  }
+}
+
+
+/* Double each row /p first up to /p last; the binomial split into its
+   even and odd taps, such that no zeroes are multiplied
+
+   even   1 6 1 / 8
+   odd     4 4  / 8
+
+*/
+static void expandRows(void *context, const int first, const int last)
+{
+  LevelContext *level = (LevelContext *) context;
+  int components = level->components;
+  int n = level->width;
+
+  for (int r = first; r < last; r++)
+  {
+    const float *source = level->source + (size_t) r * n * components;
+    float *target = level->target + (size_t) r * level->targetWidth * components;
+
+    for (int x = 0; x < level->targetWidth; x++)
+    {
+      int i = x / 2;
+      const float *left = source + clampIndex(i - 1, n) * components;
+      const float *center = source + clampIndex(i, n) * components;
+      const float *right = source + clampIndex(i + 1, n) * components;
+      float *pixel = target + x * components;
+
+      for (int c = 0; c < components; c++)
+      {
+        pixel[c] = x & 1
+          ? (center[c] + right[c]) * 0.5f
+          : (left[c] + 6 * center[c] + right[c]) * 0.125f;
+      }
+    }
+  }
+}
+
+
+/* Target rows /p first up to /p last, each interpolated from the one or
+   three source rows about half its index */
+static void expandColumns(void *context, const int first, const int last)
+{
+  LevelContext *level = (LevelContext *) context;
+  int stride = level->width * level->components;
+  int n = level->height;
+
+  for (int r = first; r < last; r++)
+  {
+    int i = r / 2;
+    float *target = level->target + (size_t) r * stride;
+    const float *center = level->source + (size_t) clampIndex(i, n) * stride;
+    const float *below = level->source + (size_t) clampIndex(i + 1, n) * stride;
+
+    if (r & 1)
+    {
+      for (int k = 0; k < stride; k++)
+      {
+        target[k] = (center[k] + below[k]) * 0.5f;
+      }
+
+      continue;
+    }
+
+    const float *above = level->source + (size_t) clampIndex(i - 1, n) * stride;
+
+    for (int k = 0; k < stride; k++)
+    {
+      target[k] = (above[k] + 6 * center[k] + below[k]) * 0.125f;
+    }
+  }
+}
+
+
+/* Halve or double an image of floats, by way of /p scratch; rows first */
+static void resample(const float *source,
+                     float *target,
+                     float *scratch,
+                     const int width,
+                     const int height,
+                     const int targetWidth,
+                     const int targetHeight,
+                     const int components,
+                     const bool reduce)
+{
+  LevelContext rows = { source, scratch, width, height,
+                        targetWidth, height, components };
+  parallelFor(height, reduce ? reduceRows : expandRows, &rows);
+
+  LevelContext columns = { scratch, target, targetWidth, height,
+                           targetWidth, targetHeight, components };
+  parallelFor(targetHeight, reduce ? reduceColumns : expandColumns, &columns);
+}
+
+
+static bool pyramidBlurTyped(const int width,
+                             const int height,
+                             const int minX,
+                             const int minY,
+                             const int maxX,
+                             const int maxY,
+                             const int components,
+                             const PixelType type,
+                             const void *in,
+                             void *out,
+                             const double sigma)
+{
+  copyUntouched(in, out, width, height, components * pixelTypeSize(type));
+
+  /* Each level down and back up adds a variance of 1 in its own pixels,
+     4^l in those of the image; the coarsest level blurs what is left
+
+       sigma^2  =  2 * (1 + 4 + ... + 4^(L-1))  +  4^L * coarse^2
+
+  */
+  int levels = 0;
+  double coarse = sigma;
+
+  while (levels < 16)
+  {
+    double scale = (double) (1 << (levels + 1));
+    double variance = sigma * sigma - 2 * (scale * scale - 1) / 3;
+
+    if (variance <= 0 || sqrt(variance) / scale < PYRAMID_SIGMA)
+    {
+      break;
+    }
+
+    levels++;
+    coarse = sqrt(variance) / scale;
+  }
+
+  int pad = (int) ceil(4 * sigma);
+
+  Region region;
+  if (!clipRegion(&region, width, height, minX, minY, maxX, maxY,
+                  components, type, in, out, pad))
+  {
+    return true;
+  }
+
+  size_t size = (size_t) region.paddedHeight * region.paddedStride;
+  float *front = (float *) malloc(size * sizeof(float));
+  float *back = (float *) malloc(size * sizeof(float));
+  float *scratch = (float *) malloc(size * sizeof(float));
+
+  if (front == NULL || back == NULL || scratch == NULL)
+  {
+    free(front);
+    free(back);
+    free(scratch);
+    return false;
+  }
+
+  copyPadded(&region, front);
+
+  int widths[17] = { region.paddedWidth };
+  int heights[17] = { region.paddedHeight };
+
+  for (int l = 0; l < levels; l++)
+  {
+    widths[l + 1] = (widths[l] + 1) / 2;
+    heights[l + 1] = (heights[l] + 1) / 2;
+
+    resample(front, back, scratch, widths[l], heights[l],
+             widths[l + 1], heights[l + 1], components, true);
+
+    float *swap = front;
+    front = back;
+    back = swap;
+  }
+
+  /* The coarsest level is blurred as by iirBlur(), through a region the
+     size of the level */
+  double coef[4];
+  computeRecursive(coef, coarse);
+
+  Region level = region;
+  level.paddedWidth = widths[levels];
+  level.paddedHeight = heights[levels];
+  level.paddedStride = widths[levels] * components;
+
+  RecursiveContext recursive = { &level, coef, front, back, false };
+  parallelFor(level.paddedHeight, recursiveRows, &recursive);
+
+  recursive.source = back;
+  recursive.target = front;
+  parallelFor(level.paddedStride, recursiveColumns, &recursive);
+
+  for (int l = levels; l > 0; l--)
+  {
+    resample(front, back, scratch, widths[l], heights[l],
+             widths[l - 1], heights[l - 1], components, false);
+
+    float *swap = front;
+    front = back;
+    back = swap;
+  }
+
+  blendRegion(&region, front, pad);
+
+  free(front);
+  free(back);
+  free(scratch);
+
+  return !recursive.failed;
+}
+
+
+bool pyramidBlur(const int width,
+                 const int height,
+                 const int minX,
+                 const int minY,
+                 const int maxX,
+                 const int maxY,
+                 const int components,
+                 const uint8_t *in,
+                 uint8_t *out,
+                 const double sigma)
+{
+  return pyramidBlurTyped(width, height, minX, minY, maxX, maxY,
+                          components, PIXEL_U8, in, out, sigma);
+}
+
+
+typedef struct
+{
+  const Region *region;
+  const uint8_t *map;
+  const float *source;        // padded values of the previous pass
+  float *target;              // padded values of this pass
+  double *table;              // summed-area table of source
+  const int *radii;           // box radius of this pass per value of map
+  int extent;                 // pixels of padding later passes still read
+  bool last;                  // whether this pass stores to the output
+} VariableContext;
+
+
+/* Row sums of rows /p first up to /p last of the padded source, into the
+   rows below them of the summed-area table; its first row and column
+   stay 0, such that no box needs a check at the edge of the table */
+static void variableTableRows(void *context, const int first, const int last)
+{
+  VariableContext *variable = (VariableContext *) context;
+  const Region *region = variable->region;
+  int components = region->components;
+  size_t tableStride = (size_t) (region->paddedWidth + 1) * components;
+
+  for (int r = first; r < last; r++)
+  {
+    const float *source = variable->source + (size_t) r * region->paddedStride;
+    double *row = variable->table + (r + 1) * tableStride;
+
+    for (int c = 0; c < components; c++)
+    {
+      row[c] = 0;
+    }
+
+    for (int i = 0; i < region->paddedStride; i++)
+    {
+      row[i + components] = row[i] + source[i];
+    }
+  }
+}
+
+
+/* Column sums of values /p first up to /p last of every row of the
+   summed-area table, walked down row by row as boxColumns() does */
+static void variableTableColumns(void *context, const int first, const int last)
+{
+  VariableContext *variable = (VariableContext *) context;
+  const Region *region = variable->region;
+  size_t tableStride = (size_t) (region->paddedWidth + 1) * region->components;
+
+  for (int r = 2; r <= region->paddedHeight; r++)
+  {
+    double *row = variable->table + r * tableStride;
+    const double *above = row - tableStride;
+
+    for (int i = first; i < last; i++)
+    {
+      row[i] += above[i];
+    }
+  }
+}
+
+
+/* Box of each pixel of rows /p first up to /p last of those this pass
+   computes, of the radius its value of the map calls for
+
+Four lookups of the summed-area table per component, whatever the radius.
+Boxes are clipped to the padded rectangle, beyond which later passes do
+not read.
+
+    a ______ b
+     |      |      sum = d - b - c + a
+     |______|
+    c        d
+
+*/
+static void variableRows(void *context, const int first, const int last)
+{
+  VariableContext *variable = (VariableContext *) context;
+  const Region *region = variable->region;
+  int components = region->components;
+  int paddedWidth = region->paddedWidth;
+  int paddedHeight = region->paddedHeight;
+  size_t tableStride = (size_t) (paddedWidth + 1) * components;
+  int begin = region->pad - variable->extent;
+  int end = region->pad + region->regionWidth + variable->extent;
+
+  for (int index = first; index < last; index++)
+  {
+    int r = region->pad - variable->extent + index;
+    int y = region->y0 - region->pad + r;
+    y = y < 0 ? 0 : y >= region->height ? region->height - 1 : y;
+
+    const uint8_t *map = variable->map + (size_t) y * region->width;
+    float *target = variable->target + (size_t) r * region->paddedStride;
+
+    for (int col = begin; col < end; col++)
+    {
+      int x = region->x0 - region->pad + col;
+      x = x < 0 ? 0 : x >= region->width ? region->width - 1 : x;
+
+      int radius = variable->radii[map[x]];
+      int top = r - radius > 0 ? r - radius : 0;
+      int bottom = r + radius < paddedHeight - 1 ? r + radius : paddedHeight - 1;
+      int left = col - radius > 0 ? col - radius : 0;
+      int right = col + radius < paddedWidth - 1 ? col + radius : paddedWidth - 1;
+      double scale = 1.0 / ((bottom - top + 1) * (right - left + 1));
+
+      const double *a = variable->table + top * tableStride + left * components;
+      const double *b = variable->table + top * tableStride + (right + 1) * components;
+      const double *c = variable->table + (bottom + 1) * tableStride + left * components;
+      const double *d = variable->table + (bottom + 1) * tableStride + (right + 1) * components;
+
+      for (int k = 0; k < components; k++)
+      {
+        target[col * components + k] = (float) ((d[k] - b[k] - c[k] + a[k]) * scale);
+      }
+    }
+
+    /* The last pass covers the rows of the rectangle alone, and stores */
+    if (variable->last)
+    {
+      void *out = (uint8_t *) region->out
+        + ((size_t) y * region->width + region->x0) * components * pixelTypeSize(region->type);
+      storeRow(out, target + begin * components, region->type, region->stride);
+    }
+  }
+}
+
+
+bool variableBlur(const int width,
+                  const int height,
+                  const int minX,
+                  const int minY,
+                  const int maxX,
+                  const int maxY,
+                  const int components,
+                  const PixelType type,
+                  const void *in,
+                  void *out,
+                  const uint8_t *map,
+                  const double maxSigma,
+                  const int passes)
+{
+  if (passes < 1 || passes > MAX_VARIABLE_PASSES || !(maxSigma >= 0))
+  {
+    return false;
+  }
+
+  copyUntouched(in, out, width, height, components * pixelTypeSize(type));
+
+  /* Box radius of each pass per value of the map, as boxBlur() picks
+     them for its sigma, and the largest of each pass */
+  int radii[MAX_VARIABLE_PASSES * 256];
+  int reach[MAX_VARIABLE_PASSES] = { 0 };
+
+  for (int m = 0; m < 256; m++)
+  {
+    int sizes[MAX_VARIABLE_PASSES];
+    computeBoxSizes(sizes, maxSigma * m / 255, passes);
+
+    for (int pass = 0; pass < passes; pass++)
+    {
+      int radius = (sizes[pass] - 1) / 2;
+      radii[pass * 256 + m] = radius;
+      reach[pass] = radius > reach[pass] ? radius : reach[pass];
+    }
+  }
+
+  /* Each pass widens the footprint by its largest radius */
+  int pad = 0;
+  for (int pass = 0; pass < passes; pass++)
+  {
+    pad += reach[pass];
+  }
+
+  Region region;
+  if (!clipRegion(&region, width, height, minX, minY, maxX, maxY,
+                  components, type, in, out, pad))
+  {
+    return true;
+  }
+
+  size_t size = (size_t) region.paddedHeight * region.paddedStride;
+  size_t tableSize = (size_t) (region.paddedHeight + 1)
+    * (region.paddedWidth + 1) * components;
+
+  float *front = (float *) malloc(size * sizeof(float));
+  float *back = (float *) malloc(size * sizeof(float));
+  double *table = (double *) malloc(tableSize * sizeof(double));
+
+  if (front == NULL || back == NULL || table == NULL)
+  {
+    free(front);
+    free(back);
+    free(table);
+    return false;
+  }
+
+  copyPadded(&region, front);
+
+  for (size_t i = 0; i < (size_t) (region.paddedWidth + 1) * components; i++)
+  {
+    table[i] = 0;
+  }
+
+  VariableContext variable = { &region, map, NULL, NULL, table, NULL, pad, false };
+
+  for (int pass = 0; pass < passes; pass++)
+  {
+    variable.source = front;
+    variable.target = back;
+    variable.radii = radii + pass * 256;
+    variable.extent -= reach[pass];
+    variable.last = pass == passes - 1;
+
+    parallelFor(region.paddedHeight, variableTableRows, &variable);
+    parallelFor((region.paddedWidth + 1) * components, variableTableColumns, &variable);
+    parallelFor(region.regionHeight + 2 * variable.extent, variableRows, &variable);
+
+    float *swap = front;
+    front = back;
+    back = swap;
+  }
+
+  free(front);
+  free(back);
+  free(table);
+
+  return true;
+}
+
+
+/* Tap of a sparse kernel; weight of the value /p dx pixels across and
+   /p dy pixels down, and of that mirrored through the center if any */
+typedef struct
+{
+  int dx;
+  int dy;
+  float weight;
+  bool mirrored;
+} Tap;
+
+
+/* An elliptical gaussian as a pass along rows or columns and a pass
+   along a line sheared off the other axis
+
+The covariance of the ellipse is split such that
+
+  | a  b |   | s  0 |       | t*t  t |
+  | b  c | = | 0  0 |  + v  | t    1 |
+
+for a pass along rows of variance s, and a pass stepping a row down and
+t pixels across per tap of variance v; or the transpose of it, for a pass
+along columns. Of the two, that with |t| <= 1 is taken, such that the
+sheared line never strays more than a pixel across per tap.
+
+Reference:
+ - Geusebroek, Smeulders & van de Weijer, "Fast anisotropic Gauss
+   filtering", IEEE Transactions on Image Processing 12(8), 2003
+
+*/
+typedef struct
+{
+  bool vertical;      // whether the first pass is along columns
+  double line;        // variance of first pass
+  double sheared;     // variance of second pass, in taps
+  double shear;       // pixels across per tap of second pass
+} Shear;
+
+
+static void decomposeAnisotropic(Shear *shear,
+                                 const double sigmaX,
+                                 const double sigmaY,
+                                 const double theta)
+{
+  double cosine = cos(theta);
+  double sine = sin(theta);
+  double a = sigmaX * sigmaX * cosine * cosine + sigmaY * sigmaY * sine * sine;
+  double b = (sigmaX * sigmaX - sigmaY * sigmaY) * cosine * sine;
+  double c = sigmaX * sigmaX * sine * sine + sigmaY * sigmaY * cosine * cosine;
+
+  shear->vertical = c < a;
+
+  double across = shear->vertical ? c : a;
+  double along = shear->vertical ? a : c;
+
+  shear->shear = along > MIN_VARIANCE ? b / along : 0;
+  shear->sheared = along;
+  shear->line = across - b * shear->shear;
+}
+
+
+/* Taps of a sampled gaussian of /p variance, stepping a row down and
+   /p shear pixels across per tap, or a column across and /p shear pixels
+   down if /p transposed; each split over the two pixels either side
+
+Samples either side of the center are interpolated by fractions that add
+up to 1, such that the kernel stays point symmetric and only those of one
+side are kept, mirrored.
+
+Returns the number of taps, at most 2 * ceil(4 sigma) + 2, and adds the
+variance their interpolation smears across to /p smear.
+
+*/
+static int shearTaps(Tap *taps,
+                     const double variance,
+                     const double shear,
+                     const bool transposed,
+                     double *smear)
+{
+  if (variance < MIN_VARIANCE)
+  {
+    taps[0] = (Tap) { 0, 0, 1, false };
+    return 1;
+  }
+
+  /* Sigma follows from the ellipse and its angle, and is rarely seen
+     twice, so the kernel is computed here rather than cached */
+  double sigma = sqrt(variance);
+  int radius = (int) ceil(4 * sigma);
+  double *kernel = (double *) malloc((2 * radius + 1) * sizeof(double));
+
+  if (kernel == NULL)
+  {
+    return 0;
+  }
+
+  double sum = computeKernel1D(kernel, 2 * radius + 1, sigma);
+  normalise(kernel, sum, 2 * radius + 1, 1);
+
+  int count = 0;
+
+  for (int k = 0; k <= radius; k++)
+  {
+    double offset = shear * k;
+    double whole = floor(offset);
+    double fraction = offset - whole;
+    double weight = kernel[k + radius];
+
+    *smear += (k > 0 ? 2 : 1) * weight * fraction * (1 - fraction);
+
+    for (int side = 0; side < 2; side++)
+    {
+      double share = side == 0 ? weight * (1 - fraction) : weight * fraction;
+
+      if (share == 0)
+      {
+        continue;
+      }
+
+      int across = (int) whole + side;
+      taps[count].dx = transposed ? k : across;
+      taps[count].dy = transposed ? across : k;
+      taps[count].weight = (float) share;
+      taps[count].mirrored = k > 0;
+      count++;
+    }
+  }
+
+  free(kernel);
+
+  return count;
+}
+
+
+/* Pixels across and down the furthest of /p count taps reaches */
+static void tapReach(const Tap *taps, const int count, int *across, int *down)
+{
+  *across = 0;
+  *down = 0;
+
+  for (int i = 0; i < count; i++)
+  {
+    int dx = abs(taps[i].dx);   // as far as its mirror
+    int dy = abs(taps[i].dy);
+    *across = dx > *across ? dx : *across;
+    *down = dy > *down ? dy : *down;
+  }
+}
+
+
+typedef struct
+{
+  const Region *region;
+  const float *source;
+  float *target;
+  const Tap *taps;
+  int count;
+  int insetX;         // pixels of padding left out on either side
+  int insetY;         //
+} TapContext;
+
+
+/* Values /p i up to /p i + /p n of a row, from /p center at the same
+   position of the source */
+static inline void tapStrip(const float *center,
+                            const TapContext *pass,
+                            float *target,
+                            const int i,
+                            const int n)
+{
+  int stride = pass->region->paddedStride;
+  int components = pass->region->components;
+  float sums[DENSE_STRIP] = { 0 };
+
+  for (int t = 0; t < pass->count; t++)
+  {
+    const Tap *tap = &pass->taps[t];
+    long offset = (long) tap->dy * stride + tap->dx * components;
+    const float *s0 = center + i + offset;
+    const float *s1 = center + i - offset;
+    float weight = tap->weight;
+
+    if (tap->mirrored)
+    {
+      for (int j = 0; j < n; j++)
+      {
+        sums[j] += weight * (s0[j] + s1[j]);
+      }
+    }
+    else
+    {
+      for (int j = 0; j < n; j++)
+      {
+        sums[j] += weight * s0[j];
+      }
+    }
+  }
+
+  for (int j = 0; j < n; j++)
+  {
+    target[i + j] = sums[j];
+  }
+}
+
+
+/* Rows /p first up to /p last of those within the inset, a strip of
+   values at a time such that its sums stay in registers across taps */
+static void tapRows(void *context, const int first, const int last)
+{
+  TapContext *pass = (TapContext *) context;
+  const Region *region = pass->region;
+  int components = region->components;
+  int stride = region->paddedStride;
+  int count = (region->paddedWidth - 2 * pass->insetX) * components;
+
+  for (int r = first; r < last; r++)
+  {
+    size_t start = (size_t) (pass->insetY + r) * stride + pass->insetX * components;
+    const float *center = pass->source + start;
+    float *target = pass->target + start;
+    int i = 0;
+
+    for (; i + DENSE_STRIP <= count; i += DENSE_STRIP)
+    {
+      tapStrip(center, pass, target, i, DENSE_STRIP);
+    }
+
+    if (i < count)
+    {
+      tapStrip(center, pass, target, i, count - i);
+    }
+  }
+}
+
+
+bool anisotropicBlur(const int width,
+                     const int height,
+                     const int minX,
+                     const int minY,
+                     const int maxX,
+                     const int maxY,
+                     const int components,
+                     const PixelType type,
+                     const void *in,
+                     void *out,
+                     const double sigmaX,
+                     const double sigmaY,
+                     const double theta)
+{
+  if (!(sigmaX >= 0) || !(sigmaY >= 0) || !isfinite(theta))
+  {
+    return false;
+  }
+
+  copyUntouched(in, out, width, height, components * pixelTypeSize(type));
+
+  Shear shear;
+  decomposeAnisotropic(&shear, sigmaX, sigmaY, theta);
+
+  /* Taps of the sheared pass first, such that the line pass can take the
+     variance their interpolation smears across off of its own */
+  double smear = 0;
+  double sheared = shear.sheared >= MIN_VARIANCE ? sqrt(shear.sheared) : 0;
+  double line = shear.line;
+  int shearedSize = 2 * ((int) ceil(4 * sheared) + 1);
+
+  Tap *taps = (Tap *) malloc(shearedSize * sizeof(Tap));
+
+  if (taps == NULL)
+  {
+    return false;
+  }
+
+  int shearedCount = shearTaps(taps, shear.sheared, shear.shear,
+                               shear.vertical, &smear);
+
+  line = line - smear > 0 ? line - smear : 0;
+  int lineSize = 2 * (int) ceil(4 * (line >= MIN_VARIANCE ? sqrt(line) : 0)) + 1;
+
+  Tap *lineTaps = (Tap *) malloc(lineSize * sizeof(Tap));
+
+  if (lineTaps == NULL || shearedCount == 0)
+  {
+    free(taps);
+    free(lineTaps);
+    return false;
+  }
+
+  double none = 0;
+  int lineCount = shearTaps(lineTaps, line, 0, !shear.vertical, &none);
+
+  if (lineCount == 0)
+  {
+    free(taps);
+    free(lineTaps);
+    return false;
+  }
+
+  /* The sheared pass covers the rectangle alone, and the line pass
+     what the sheared pass reads of it */
+  int shearedX, shearedY, lineX, lineY;
+  tapReach(taps, shearedCount, &shearedX, &shearedY);
+  tapReach(lineTaps, lineCount, &lineX, &lineY);
+
+  int padX = shearedX + lineX;
+  int padY = shearedY + lineY;
+  int pad = padX > padY ? padX : padY;
+
+  Region region;
+  if (!clipRegion(&region, width, height, minX, minY, maxX, maxY,
+                  components, type, in, out, pad))
+  {
+    free(taps);
+    free(lineTaps);
+    return true;
+  }
+
+  size_t size = (size_t) region.paddedHeight * region.paddedStride;
+  float *source = (float *) malloc(size * sizeof(float));
+  float *filtered = (float *) malloc(size * sizeof(float));
+
+  if (source == NULL || filtered == NULL)
+  {
+    free(taps);
+    free(lineTaps);
+    free(source);
+    free(filtered);
+    return false;
+  }
+
+  copyPadded(&region, source);
+
+  TapContext pass = { &region, source, filtered, lineTaps, lineCount,
+                      pad - shearedX, pad - shearedY };
+  parallelFor(region.paddedHeight - 2 * pass.insetY, tapRows, &pass);
+
+  pass.source = filtered;
+  pass.target = source;
+  pass.taps = taps;
+  pass.count = shearedCount;
+  pass.insetX = pad;
+  pass.insetY = pad;
+  parallelFor(region.regionHeight, tapRows, &pass);
+
+  blendRegion(&region, source, pad);
+
+  free(taps);
+  free(lineTaps);
+  free(source);
+  free(filtered);
+
+  return true;
+}
+
+
+typedef struct
+{
+  const Region *region;
+  const float *padded;
+  Spectrum *spectrum;
+  bool failed;
+} SpectrumContext;
+
+
+/* Transform components /p first up to /p last */
+static void transformComponents(void *context, const int first, const int last)
+{
+  SpectrumContext *transform = (SpectrumContext *) context;
+  const Region *region = transform->region;
+  Spectrum *spectrum = transform->spectrum;
+
+  int N = spectrum->size[0];
+  int M = spectrum->size[1];
+  size_t planeSize = (size_t) M * (N / 2 + 1) * 2;
+
+  double *plane = (double *) calloc((size_t) N * M, sizeof(double));
+
+  if (plane == NULL)
+  {
+    transform->failed = true;
+    return;
+  }
+
+  /* Beyond the padding, the transform is zero-filled; the kernel
+     never reaches that far from the rectangle */
+  for (int c = first; c < last; c++)
+  {
+    for (int r = 0; r < region->paddedHeight; r++)
+    {
+      for (int x = 0; x < region->paddedWidth; x++)
+      {
+        plane[(size_t) r * N + x] = transform->padded[
+          (size_t) r * region->paddedStride + x * region->components + c];
+      }
+    }
+
+    fftReal2D(plane, spectrum->data + c * planeSize, N, M);
+  }
+
+  free(plane);
+}
+
+
+static Spectrum *computeSpectrumTyped(const int width,
+                                      const int height,
+                                      const int minX,
+                                      const int minY,
+                                      const int maxX,
+                                      const int maxY,
+                                      const int components,
+                                      const PixelType type,
+                                      const void *in,
+                                      const int maxKernelSize)
+{
+  if (maxKernelSize % 2 != 1)
+  {
+    return NULL;
+  }
+
+  Region region;
+  if (!clipRegion(&region, width, height, minX, minY, maxX, maxY,
+                  components, type, in, NULL, (maxKernelSize - 1) / 2))
+  {
+    clipRegion(&region, width, height, 0, 0, 0, 0,
+               components, type, in, NULL, (maxKernelSize - 1) / 2);
+  }
+
+  Spectrum *spectrum = (Spectrum *) malloc(sizeof(Spectrum));
+
+  if (spectrum == NULL)
+  {
+    return NULL;
+  }
+
+  spectrum->width = width;
+  spectrum->height = height;
+  spectrum->components = components;
+  spectrum->type = type;
+  spectrum->minX = minX;
+  spectrum->minY = minY;
+  spectrum->maxX = maxX;
+  spectrum->maxY = maxY;
+  spectrum->maxKernelSize = maxKernelSize;
+  spectrum->size[0] = fftSize(region.paddedWidth);
+  spectrum->size[1] = fftSize(region.paddedHeight);
+
+  int N = spectrum->size[0];
+  int M = spectrum->size[1];
+  size_t planeSize = (size_t) M * (N / 2 + 1) * 2;
+
+  float *padded = (float *) malloc((size_t) region.paddedHeight * region.paddedStride * sizeof(float));
+  spectrum->data = (double *) malloc(components * planeSize * sizeof(double));
+
+  if (padded == NULL || spectrum->data == NULL)
+  {
+    free(padded);
+    freeSpectrum(spectrum);
+    return NULL;
+  }
+
+  copyPadded(&region, padded);
+
+  /* One component per band */
+  SpectrumContext transform = { &region, padded, spectrum, false };
+  parallelFor(components, transformComponents, &transform);
+
+  free(padded);
+
+  if (transform.failed)
+  {
+    freeSpectrum(spectrum);
+    return NULL;
+  }
+
+  return spectrum;
+}
+
+
+Spectrum *computeSpectrum(const int width,
+                          const int height,
+                          const int minX,
+                          const int minY,
+                          const int maxX,
+                          const int maxY,
+                          const int components,
+                          const uint8_t *in,
+                          const int maxKernelSize)
+{
+  return computeSpectrumTyped(width, height, minX, minY, maxX, maxY,
+                              components, PIXEL_U8, in, maxKernelSize);
+}
+
+
+typedef struct
+{
+  const Region *region;
+  const Spectrum *spectrum;
+  const double *kernelSpectrum;
+  float *blurred;
+  bool failed;
+} ProductContext;
+
+
+/* Multiply, and transform back, components /p first up to /p last */
+static void multiplyComponents(void *context, const int first, const int last)
+{
+  ProductContext *multiply = (ProductContext *) context;
+  const Region *region = multiply->region;
+  const Spectrum *spectrum = multiply->spectrum;
+  const double *kernelSpectrum = multiply->kernelSpectrum;
+
+  int components = region->components;
+  int pad = (spectrum->maxKernelSize - 1) / 2;
+  int N = spectrum->size[0];
+  int M = spectrum->size[1];
+  size_t planeSize = (size_t) M * (N / 2 + 1) * 2;
+
+  double *plane = (double *) malloc((size_t) N * M * sizeof(double));
+  double *product = (double *) malloc(planeSize * sizeof(double));
+
+  if (plane == NULL || product == NULL)
+  {
+    free(plane);
+    free(product);
+    multiply->failed = true;
+    return;
+  }
+
+  for (int c = first; c < last; c++)
+  {
+    const double *image = spectrum->data + c * planeSize;
+
+    for (size_t i = 0; i < planeSize; i += 2)
+    {
+      product[i] = image[i] * kernelSpectrum[i] - image[i + 1] * kernelSpectrum[i + 1];
+      product[i + 1] = image[i] * kernelSpectrum[i + 1] + image[i + 1] * kernelSpectrum[i];
+    }
+
+    fftRealInverse2D(product, plane, N, M);
+
+    for (int r = 0; r < region->regionHeight; r++)
+    {
+      const double *source = plane + (size_t) (r + pad) * N + pad;
+      float *target = multiply->blurred + (size_t) r * region->stride + c;
+
+      for (int x = 0; x < region->regionWidth; x++)
+      {
+        target[x * components] = (float) source[x];
+      }
+    }
+  }
+
+  free(plane);
+  free(product);
+}
+
+
+static bool convolveSpectrumTyped(const Spectrum *spectrum,
+                                  const void *in,
+                                  void *out,
+                                  const double *kernel,
+                                  const int kernelSize)
+{
+  if (kernelSize % 2 != 1 || kernelSize > spectrum->maxKernelSize)
+  {
+    return false;
+  }
+
+  int width = spectrum->width;
+  int height = spectrum->height;
+  int components = spectrum->components;
+  PixelType type = spectrum->type;
+
+  copyUntouched(in, out, width, height, components * pixelTypeSize(type));
+
+  Region region;
+  if (!clipRegion(&region, width, height,
+                  spectrum->minX, spectrum->minY,
+                  spectrum->maxX, spectrum->maxY,
+                  components, type, in, out, 0))
+  {
+    return true;
+  }
+
+  int margin = (kernelSize - 1) / 2;
+  int N = spectrum->size[0];
+  int M = spectrum->size[1];
+  size_t planeSize = (size_t) M * (N / 2 + 1) * 2;
+
+  double *plane = (double *) calloc((size_t) N * M, sizeof(double));
+  double *kernelSpectrum = (double *) malloc(planeSize * sizeof(double));
+  float *blurred = (float *) malloc((size_t) region.regionHeight * region.stride * sizeof(float));
+
+  if (plane == NULL || kernelSpectrum == NULL || blurred == NULL)
+  {
+    free(plane);
+    free(kernelSpectrum);
+    free(blurred);
+    return false;
+  }
+
+  /* The kernel is wrapped around the origin such that the product of
+     spectra samples the same neighbourhood as convolve()
+
+      kernel          plane
+       _______         ___________
+      |a  |b  |       |d  |   |c  |
+      |___|___|  -->  |___|___|___|
+      |c  |d  |       |   |   |   |
+      |___|___|       |b__|___|a__|
+
+  */
+  for (int row = 0; row < kernelSize; row++)
+  {
+    for (int col = 0; col < kernelSize; col++)
+    {
+      int u = (margin - row + M) % M;
+      int v = (margin - col + N) % N;
+      plane[(size_t) u * N + v] = kernel[row * kernelSize + col];
+    }
+  }
+
+  fftReal2D(plane, kernelSpectrum, N, M);
+
+  /* One component per band */
+  ProductContext multiply = { &region, spectrum, kernelSpectrum, blurred, false };
+  parallelFor(components, multiplyComponents, &multiply);
+
+  if (!multiply.failed)
+  {
+    blendRegion(&region, blurred, 0);
+  }
+
+  free(plane);
+  free(kernelSpectrum);
+  free(blurred);
+
+  return !multiply.failed;
+}
+
+
+bool convolveSpectrum(const Spectrum *spectrum,
+                      const uint8_t *in,
+                      uint8_t *out,
+                      const double *kernel,
+                      const int kernelSize)
+{
+  return convolveSpectrumTyped(spectrum, in, out, kernel, kernelSize);
+}
+
+
+void freeSpectrum(Spectrum *spectrum)
+{
+  if (spectrum == NULL)
+  {
+    return;
+  }
+
+  free(spectrum->data);
+  free(spectrum);
+}
+
+
+static bool convolveFFTTyped(const int width,
+                             const int height,
+                             const int minX,
+                             const int minY,
+                             const int maxX,
+                             const int maxY,
+                             const int components,
+                             const PixelType type,
+                             const void *in,
+                             void *out,
+                             const double *kernel,
+                             const int kernelSize)
+{
+  Spectrum *spectrum = computeSpectrumTyped(width, height, minX, minY, maxX, maxY,
+                                            components, type, in, kernelSize);
+
+  if (spectrum == NULL)
+  {
+    return false;
+  }
+
+  bool ok = convolveSpectrumTyped(spectrum, in, out, kernel, kernelSize);
+  freeSpectrum(spectrum);
+
+  return ok;
+}
+
+
+bool convolveFFT(const int width,
+                 const int height,
+                 const int minX,
+                 const int minY,
+                 const int maxX,
+                 const int maxY,
+                 const int components,
+                 const uint8_t *in,
+                 uint8_t *out,
+                 const double *kernel,
+                 const int kernelSize)
+{
+  return convolveFFTTyped(width, height, minX, minY, maxX, maxY,
+                          components, PIXEL_U8, in, out, kernel, kernelSize);
+}
+
+
+int quantiseKernel(const double *kernel,
+                   int16_t *out,
+                   const int count,
+                   const int shift)
+{
+  int one = 1 << shift;
+  int sum = 0;
+
+  for (int i = 0; i < count; i++)
+  {
+    double v = floor(kernel[i] * one + 0.5);
+    v = v < INT16_MIN ? INT16_MIN : v > INT16_MAX ? INT16_MAX : v;
+    out[i] = (int16_t) v;
+    sum += out[i];
+  }
+
+  /* Whatever rounding lost or gained goes to the center tap, which
+     keeps symmetric kernels symmetric */
+  int center = out[count / 2] + one - sum;
+
+  if (center < INT16_MIN || center > INT16_MAX)
+  {
+    return 1;
+  }
+
+  out[count / 2] = (int16_t) center;
+
+  return 0;
+}
+
+
+typedef struct
+{
+  const Region *region;
+  const FixedPasses *passes;
+  const int16_t *weights;
+  int kernelSize;
+  Tiling tiling;
+  bool failed;
+} FixedContext;
+
+
+static void fixedFullTiles(void *context, const int first, const int last)
+{
+  FixedContext *fixed = (FixedContext *) context;
+  const Region *region = fixed->region;
+  int kernelSize = fixed->kernelSize;
+  int components = region->components;
+
+  int size = fixed->tiling.size;
+  size_t paddedSize = (size_t) (size + 2 * region->pad) * (size + 2 * region->pad) * components;
+
+  uint8_t *padded = (uint8_t *) malloc(paddedSize * sizeof(uint8_t));
+  const uint8_t **rows = (const uint8_t **) malloc(kernelSize * sizeof(uint8_t *));
+  uint8_t *blurred = (uint8_t *) malloc(size * components * sizeof(uint8_t));
+
+  if (padded == NULL || rows == NULL || blurred == NULL)
+  {
+    free(padded);
+    free(rows);
+    free(blurred);
+    fixed->failed = true;
+    return;
+  }
+
+  for (int index = first; index < last; index++)
+  {
+    Region tile;
+    selectTile(&tile, region, &fixed->tiling, index);
+
+    if (tileMasked(&tile))
+    {
+      continue;
+    }
+
+    PaddedContext copy = { &tile, NULL, padded };
+    copyPaddedFixedRows(&copy, 0, tile.paddedHeight);
+
+    for (int r = 0; r < tile.regionHeight; r++)
+    {
+      int begin, end;
+      weightSpan(&tile, tile.y0 + r, &begin, &end);
+
+      if (begin == end)
+      {
+        continue;
+      }
+
+      for (int t = 0; t < kernelSize; t++)
+      {
+        rows[t] = padded + (size_t) (r + t) * tile.paddedStride;
+      }
+
+      fixed->passes->full(rows, blurred, fixed->weights, kernelSize, components,
+                          (begin - tile.x0) * components,
+                          (end - tile.x0) * components);
+
+      blendRowFixed(&tile, blurred, tile.y0 + r);
+    }
+  }
+
+  free(padded);
+  free(rows);
+  free(blurred);
+}
+
+
+/* As convolveFixed(), with weights quantised up front */
+static bool convolveFixedWeights(const int width,
+                                 const int height,
+                                 const int minX,
+                                 const int minY,
+                                 const int maxX,
+                                 const int maxY,
+                                 const int components,
+                                 const uint8_t *in,
+                                 uint8_t *out,
+                                 const int16_t *weights,
+                                 const int kernelSize)
+{
+  if (kernelSize % 2 != 1)
+  {
+    return false;
+  }
+
+  int margin = (kernelSize - 1) / 2;
+
+  copyUntouched(in, out, width, height, components);
+
+  Region region;
+  if (!clipRegion(&region, width, height, minX, minY, maxX, maxY,
+                  components, PIXEL_U8, in, out, margin))
+  {
+    return true;
+  }
+
+  FixedContext fixed = { &region, fixedPasses(), weights, kernelSize,
+                         { 0, 0, 0 }, false };
+  computeTiling(&fixed.tiling, &region,
+                computeTileSize(components * sizeof(uint8_t), margin));
+  parallelFor(fixed.tiling.count, fixedFullTiles, &fixed);
+
+  return !fixed.failed;
+}
+
+
+bool convolveFixed(const int width,
+                   const int height,
+                   const int minX,
+                   const int minY,
+                   const int maxX,
+                   const int maxY,
+                   const int components,
+                   const uint8_t *in,
+                   uint8_t *out,
+                   const double *kernel,
+                   const int kernelSize)
+{
+  if (kernelSize % 2 != 1)
+  {
+    return false;
+  }
+
+  int16_t *weights = (int16_t *) malloc(kernelSize * kernelSize * sizeof(int16_t));
+
+  if (weights == NULL
+      || quantiseKernel(kernel, weights, kernelSize * kernelSize, FIXED_SHIFT) != 0)
+  {
+    free(weights);
+    return false;
+  }
+
+  bool ok = convolveFixedWeights(width, height, minX, minY, maxX, maxY,
+                                 components, in, out, weights, kernelSize);
+
+  free(weights);
+
+  return ok;
+}
+
+
+static void fixedTiles(void *context, const int first, const int last)
+{
+  FixedContext *fixed = (FixedContext *) context;
+  const Region *region = fixed->region;
+  int kernelSize = fixed->kernelSize;
+  int margin = (kernelSize - 1) / 2;
+  int components = region->components;
+
+  int size = fixed->tiling.size;
+  size_t paddedSize = (size_t) (size + 2 * region->pad) * (size + 2 * region->pad) * components;
+  size_t horizontalSize = (size_t) (size + 2 * region->pad) * size * components;
+
+  uint8_t *padded = (uint8_t *) malloc(paddedSize * sizeof(uint8_t));
+  int16_t *horizontal = (int16_t *) malloc(horizontalSize * sizeof(int16_t));
+  const int16_t **taps = (const int16_t **) malloc(kernelSize * sizeof(int16_t *));
+  uint8_t *blurred = (uint8_t *) malloc(size * components * sizeof(uint8_t));
+  int *spans = (int *) malloc(2 * size * sizeof(int));
+
+  if (padded == NULL || horizontal == NULL || taps == NULL || blurred == NULL
+      || spans == NULL)
+  {
+    free(padded);
+    free(horizontal);
+    free(taps);
+    free(blurred);
+    free(spans);
+    fixed->failed = true;
+    return;
+  }
+
+  for (int index = first; index < last; index++)
+  {
+    Region tile;
+    selectTile(&tile, region, &fixed->tiling, index);
+
+    if (!tileSpans(&tile, spans))
+    {
+      continue;
+    }
+
+    PaddedContext copy = { &tile, NULL, padded };
+    copyPaddedFixedRows(&copy, 0, tile.paddedHeight);
+
+    /* Horizontal pass, kept in 16 bits with FIXED_SHIFT - FIXED_INTERMEDIATE
+       bits of fraction; enough for any kernel of non-negative weights.
+       Only the values the vertical pass reads are produced */
+    for (int r = 0; r < tile.paddedHeight; r++)
+    {
+      int spanFirst, spanCount;
+      spanUnion(spans, tile.regionHeight, r - 2 * margin, r + 1,
+                &spanFirst, &spanCount);
+
+      fixed->passes->horizontal(padded + (size_t) r * tile.paddedStride,
+                                horizontal + (size_t) r * tile.stride,
+                                fixed->weights, kernelSize,
+                                components, spanFirst, spanCount);
+    }
+
+    /* Vertical pass, followed by mixing with the source */
+    for (int r = 0; r < tile.regionHeight; r++)
+    {
+      if (spans[2 * r] == spans[2 * r + 1])
+      {
+        continue;
+      }
+
+      for (int t = 0; t < kernelSize; t++)
+      {
+        taps[t] = horizontal + (size_t) (r + t) * tile.stride;
+      }
+
+      fixed->passes->vertical(taps, blurred, fixed->weights, kernelSize,
+                              spans[2 * r], spans[2 * r + 1]);
+
+      blendRowFixed(&tile, blurred, tile.y0 + r);
+    }
+  }
+
+  free(padded);
+  free(horizontal);
+  free(taps);
+  free(blurred);
+  free(spans);
+}
+
+
+/* As convolveSeparableFixed(), with weights quantised up front */
+static bool convolveSeparableFixedWeights(const int width,
+                                          const int height,
+                                          const int minX,
+                                          const int minY,
+                                          const int maxX,
+                                          const int maxY,
+                                          const int components,
+                                          const uint8_t *in,
+                                          uint8_t *out,
+                                          const int16_t *weights,
+                                          const int kernelSize)
+{
+  if (kernelSize % 2 != 1)
+  {
+    return false;
+  }
+
+  int margin = (kernelSize - 1) / 2;
+
+  copyUntouched(in, out, width, height, components);
+
+  Region region;
+  if (!clipRegion(&region, width, height, minX, minY, maxX, maxY,
+                  components, PIXEL_U8, in, out, margin))
+  {
+    return true;
+  }
+
+  FixedContext fixed = { &region, fixedPasses(), weights, kernelSize,
+                         { 0, 0, 0 }, false };
+  computeTiling(&fixed.tiling, &region,
+                computeTileSize(components * (sizeof(uint8_t) + sizeof(int16_t)), margin));
+  parallelFor(fixed.tiling.count, fixedTiles, &fixed);
+
+  return !fixed.failed;
+}
+
+
+bool convolveSeparableFixed(const int width,
+                            const int height,
+                            const int minX,
+                            const int minY,
+                            const int maxX,
+                            const int maxY,
+                            const int components,
+                            const uint8_t *in,
+                            uint8_t *out,
+                            const double *kernel,
+                            const int kernelSize)
+{
+  if (kernelSize % 2 != 1)
+  {
+    return false;
+  }
+
+  int16_t *weights = (int16_t *) malloc(kernelSize * sizeof(int16_t));
+
+  if (weights == NULL
+      || quantiseKernel(kernel, weights, kernelSize, FIXED_SHIFT) != 0)
+  {
+    free(weights);
+    return false;
+  }
+
+  bool ok = convolveSeparableFixedWeights(width, height, minX, minY, maxX, maxY,
+                                          components, in, out, weights, kernelSize);
+
+  free(weights);
+
+  return ok;
+}
+
+
+bool gaussianBlurTyped(const int width,
+                       const int height,
+                       const int minX,
+                       const int minY,
+                       const int maxX,
+                       const int maxY,
+                       const int components,
+                       const PixelType type,
+                       const void *in,
+                       void *out,
+                       const int kernelSize,
+                       const double sigma,
+                       const BlurMode mode)
+{
+  /* Once the kernel spans the gaussian out to 3 sigma, truncating it
+     no longer matters and the recursive filter gives the same result
+     at a cost independent of sigma */
+  BlurMode strategy = mode;
+  if (strategy == BLUR_AUTO)
+  {
+    bool covered = (kernelSize - 1) / 2 >= 3 * sigma;
+    strategy = covered && sigma >= RECURSIVE_SIGMA ? BLUR_IIR : BLUR_FIXED;
+  }
+
+  /* Fixed point only has the headroom for 8 bits */
+  if (type != PIXEL_U8 && strategy == BLUR_FIXED)
+  {
+    strategy = BLUR_SEPARABLE;
+  }
+
+  if (type != PIXEL_U8 && strategy == BLUR_INTERPOLATED)
+  {
+    return false;
+  }
+
+  if (strategy == BLUR_IIR)
+  {
+    return iirBlurTyped(width, height, minX, minY, maxX, maxY,
+                        components, type, in, out, sigma);
+  }
+
+  if (strategy == BLUR_PYRAMID)
+  {
+    return pyramidBlurTyped(width, height, minX, minY, maxX, maxY,
+                            components, type, in, out, sigma);
+  }
+
+  if (strategy == BLUR_BOX)
+  {
+    return boxBlurTyped(width, height, minX, minY, maxX, maxY,
+                        components, type, in, out, sigma);
+  }
+
+  /* Kernels come from the shared cache; the gaussian is separable, so
+     only its 1d kernel is needed unless the engine takes a square one */
+  bool ok;
+  if (strategy == BLUR_DIRECT
+      || strategy == BLUR_INTERPOLATED
+      || strategy == BLUR_FFT)
+  {
+    const double *kernel = (const double *) cachedKernel(kernelSize, sigma, KERNEL_2D);
+
+    if (kernel == NULL)
+    {
+      return false;
+    }
+
+    if (strategy == BLUR_DIRECT)
+    {
+      ok = convolveTyped(width, height, minX, minY, maxX, maxY,
+                         components, type, in, out, kernel, kernelSize);
+    }
+    else if (strategy == BLUR_INTERPOLATED)
+    {
+      ok = convolveInterpolated(width, height, minX, minY, maxX, maxY,
+                                components, in, out, kernel, kernelSize);
+    }
+    else
+    {
+      ok = convolveFFTTyped(width, height, minX, minY, maxX, maxY,
+                            components, type, in, out, kernel, kernelSize);
+    }
+  }
+  else if (strategy == BLUR_FIXED)
+  {
+    const int16_t *weights = (const int16_t *) cachedKernel(kernelSize, sigma, KERNEL_FIXED_1D);
+
+    if (weights == NULL)
+    {
+      return false;
+    }
+
+    ok = convolveSeparableFixedWeights(width, height, minX, minY, maxX, maxY,
+                                       components, in, out, weights, kernelSize);
+  }
+  else
+  {
+    const double *kernel = (const double *) cachedKernel(kernelSize, sigma, KERNEL_1D);
+
+    if (kernel == NULL)
+    {
+      return false;
+    }
+
+    ok = convolveSeparableTyped(width, height, minX, minY, maxX, maxY,
+                                components, type, in, out, kernel, kernelSize);
+  }
+
+  return ok;
+}
+
+
+bool gaussianBlur(const int width,
+                  const int height,
+                  const int minX,
+                  const int minY,
+                  const int maxX,
+                  const int maxY,
+                  const int components,
+                  const uint8_t *in,
+                  uint8_t *out,
+                  const int kernelSize,
+                  const double sigma,
+                  const BlurMode mode)
+{
+  return gaussianBlurTyped(width, height, minX, minY, maxX, maxY,
+                           components, PIXEL_U8, in, out,
+                           kernelSize, sigma, mode);
+}
+
+
+
+/* Whether two rectangles share a pixel */
+static bool areasOverlap(const Area *a, const Area *b)
+{
+  return a->minX <= b->maxX && b->minX <= a->maxX
+    && a->minY <= b->maxY && b->minY <= a->maxY;
+}
+
+
+bool gaussianBlurAreas(const int width,
+                       const int height,
+                       const Area *areas,
+                       const int count,
+                       const int components,
+                       const PixelType type,
+                       const void *in,
+                       void *out,
+                       const int kernelSize,
+                       const double sigma,
+                       const BlurMode mode)
+{
+  copyImage(in, out, width, height, components * pixelTypeSize(type));
+
+  if (count <= 0)
+  {
+    return true;
+  }
+
+  Area *bounds = (Area *) malloc(count * sizeof(Area));
+  Area *members = (Area *) malloc(count * sizeof(Area));
+  Ramp *ramps = (Ramp *) malloc(count * sizeof(Ramp));
+  int *group = (int *) malloc(count * sizeof(int));
+
+  if (bounds == NULL || members == NULL || ramps == NULL || group == NULL)
+  {
+    free(bounds);
+    free(members);
+    free(ramps);
+    free(group);
+    return false;
+  }
+
+  for (int i = 0; i < count; i++)
+  {
+    bounds[i] = areas[i];
+    group[i] = i;
+  }
+
+  /* Merge groups whose bounds overlap until none do, as bounds grown by
+     a merge may come to overlap a group they did not before
+
+     Each group is kept by the first of its areas, with group[i] == i.
+
+  */
+  bool merged = true;
+  while (merged)
+  {
+    merged = false;
+
+    for (int i = 0; i < count; i++)
+    {
+      for (int j = i + 1; group[i] == i && j < count; j++)
+      {
+        if (group[j] != j || !areasOverlap(&bounds[i], &bounds[j]))
+        {
+          continue;
+        }
+
+        bounds[i].minX = bounds[j].minX < bounds[i].minX ? bounds[j].minX : bounds[i].minX;
+        bounds[i].minY = bounds[j].minY < bounds[i].minY ? bounds[j].minY : bounds[i].minY;
+        bounds[i].maxX = bounds[j].maxX > bounds[i].maxX ? bounds[j].maxX : bounds[i].maxX;
+        bounds[i].maxY = bounds[j].maxY > bounds[i].maxY ? bounds[j].maxY : bounds[i].maxY;
+
+        for (int k = j; k < count; k++)
+        {
+          group[k] = group[k] == j ? i : group[k];
+        }
+
+        merged = true;
+      }
+    }
+  }
+
+  /* One pass of an engine per group, over its bounds, blending by the
+     falloff of each of its members */
+  bool ok = true;
+
+  for (int i = 0; ok && i < count; i++)
+  {
+    if (group[i] != i)
+    {
+      continue;
+    }
+
+    int memberCount = 0;
+    for (int k = i; k < count; k++)
+    {
+      if (group[k] == i)
+      {
+        setupRamp(&ramps[memberCount], areas[k].minX, areas[k].minY,
+                  areas[k].maxX, areas[k].maxY, true);
+        members[memberCount++] = areas[k];
+      }
+    }
+
+    blendAreas = members;
+    blendRamps = ramps;
+    blendAreaCount = memberCount;
+
+    ok = gaussianBlurTyped(width, height,
+                           bounds[i].minX, bounds[i].minY,
+                           bounds[i].maxX, bounds[i].maxY,
+                           components, type, in, out,
+                           kernelSize, sigma, mode);
+  }
+
+  blendAreas = NULL;
+  blendRamps = NULL;
+  blendAreaCount = 0;
+
+  free(bounds);
+  free(members);
+  free(ramps);
+  free(group);
+
+  return ok;
+}
+
+
+typedef struct
+{
+  const Region *region;   // in and out alike
+  const float *taps;
+  int kernelSize;
+  bool symmetric;         // taps read the same backwards
+  int bands;
+  float *kept;            // filtered rows kept aside, see keptRow()
+  int boundaryRows;       // of kept, either side of boundaries of bands
+  int aboveRows;          // of kept, above the image
+  int belowRows;          // of kept, below the image
+  bool failed;
+} InPlaceContext;
+
+
+/* First row of the region, relative to y0, of band /p band */
+static int bandRow(const InPlaceContext *inPlace, const int band)
+{
+  return (int) ((int64_t) band * inPlace->region->regionHeight / inPlace->bands);
+}
+
+
+/* Index into the rows kept aside of source row /p row, as read by band
+   /p band, or -1 if the band may filter it from the image itself
+
+Rows kept aside are those another band may overwrite before they are
+read; i.e. those within /p pad of a boundary between bands, and those
+beyond the edge of the image, which the border mode maps onto any row.
+
+*/
+static int keptRow(const InPlaceContext *inPlace, const int row, const int band)
+{
+  const Region *region = inPlace->region;
+  int pad = region->pad;
+
+  if (row < 0)
+  {
+    return inPlace->boundaryRows + row - (region->y0 - pad);
+  }
+
+  if (row >= region->height)
+  {
+    return inPlace->boundaryRows + inPlace->aboveRows + row - region->height;
+  }
+
+  int begin = region->y0 + bandRow(inPlace, band);
+  int end = region->y0 + bandRow(inPlace, band + 1);
+
+  if (row < region->y0 || row > region->y1 || (row >= begin && row < end))
+  {
+    return -1;
+  }
+
+  int boundary = row < begin ? band : band + 1;
+
+  return (boundary - 1) * 2 * pad
+    + row - (region->y0 + bandRow(inPlace, boundary) - pad);
+}
+
+
+/* Horizontal pass over a padded row of a region, into /p target */
+static void filterLine(const Region *region,
+                       const float *taps,
+                       const int kernelSize,
+                       const bool symmetric,
+                       const float *line,
+                       float *target)
+{
+  filterValues(taps, kernelSize, symmetric, region->components,
+               line, target, 0, region->stride);
+}
+
+
+/* Horizontal pass over source row /p row, into /p target
+
+The row is read by way of a view of the region one row high, whose
+padded row 0 is /p row, such that the halo is looked up as for tiles.
+
+*/
+static void filterRow(const InPlaceContext *inPlace,
+                      const int row,
+                      float *line,
+                      float *target)
+{
+  const Region *region = inPlace->region;
+
+  Region view = *region;
+  view.y0 = row + region->pad;
+
+  PaddedContext copy = { &view, line, NULL };
+  copyPaddedRows(&copy, 0, 1);
+
+  filterLine(region, inPlace->taps, inPlace->kernelSize, inPlace->symmetric,
+             line, target);
+}
+
+
+/* Rows /p first up to /p last kept aside, in the order of keptRow() */
+static void filterKept(void *context, const int first, const int last)
+{
+  InPlaceContext *inPlace = (InPlaceContext *) context;
+  const Region *region = inPlace->region;
+  int pad = region->pad;
+
+  float *line = (float *) malloc(region->paddedStride * sizeof(float));
+
+  if (line == NULL)
+  {
+    inPlace->failed = true;
+    return;
+  }
+
+  for (int i = first; i < last; i++)
+  {
+    int row;
+
+    if (i < inPlace->boundaryRows)
+    {
+      int boundary = 1 + i / (2 * pad);
+      row = region->y0 + bandRow(inPlace, boundary) - pad + i % (2 * pad);
+    }
+    else if (i < inPlace->boundaryRows + inPlace->aboveRows)
+    {
+      row = region->y0 - pad + i - inPlace->boundaryRows;
+    }
+    else
+    {
+      row = region->height + i - inPlace->boundaryRows - inPlace->aboveRows;
+    }
+
+    filterRow(inPlace, row, line, inPlace->kept + (size_t) i * region->stride);
+  }
+
+  free(line);
+}
+
+
+/* Bands /p first up to /p last, each streamed top to bottom through a
+   ring of kernelSize filtered rows
+
+          ring
+  row-2  |____|  <- overwritten, but still held
+  row-1  |____|
+  row    |____|  -> written back, mixed with the source
+  row+1  |____|
+  row+2  |____|  <- filtered last
+
+*/
+static void inPlaceBands(void *context, const int first, const int last)
+{
+  InPlaceContext *inPlace = (InPlaceContext *) context;
+  const Region *region = inPlace->region;
+  int kernelSize = inPlace->kernelSize;
+  int pad = region->pad;
+  int stride = region->stride;
+
+  float *line = (float *) malloc(region->paddedStride * sizeof(float));
+  float *ring = (float *) malloc((size_t) kernelSize * stride * sizeof(float));
+  float *accumulator = (float *) malloc(stride * sizeof(float));
+  const float **rows = (const float **) malloc(kernelSize * sizeof(float *));
+
+  if (line == NULL || ring == NULL || accumulator == NULL || rows == NULL)
+  {
+    free(line);
+    free(ring);
+    free(accumulator);
+    free(rows);
+    inPlace->failed = true;
+    return;
+  }
+
+  for (int band = first; band < last; band++)
+  {
+    int begin = region->y0 + bandRow(inPlace, band);
+    int end = region->y0 + bandRow(inPlace, band + 1);
+
+    for (int row = begin - 2 * pad; row < end; row++)
+    {
+      /* Filter the row entering the ring, unless it is kept aside */
+      int source = row + pad;
+      int kept = keptRow(inPlace, source, band);
+      float *slot = ring + (size_t) (source - (begin - pad)) % kernelSize * stride;
+
+      if (kept >= 0)
+      {
+        memcpy(slot, inPlace->kept + (size_t) kept * stride, stride * sizeof(float));
+      }
+      else
+      {
+        filterRow(inPlace, source, line, slot);
+      }
+
+      if (row < begin)
+      {
+        continue;
+      }
+
+      /* Vertical pass, oldest row of the ring first */
+      for (int t = 0; t < kernelSize; t++)
+      {
+        rows[t] = ring
+          + (size_t) (row - pad + t - (begin - pad)) % kernelSize * stride;
+      }
+
+      filterColumns(inPlace->taps, kernelSize, inPlace->symmetric, rows,
+                    accumulator, 0, stride);
+
+      blendRow(region, accumulator, row);
+    }
+  }
+
+  free(line);
+  free(ring);
+  free(accumulator);
+  free(rows);
+}
+
+
+bool gaussianBlurInPlace(const int width,
+                         const int height,
+                         const int minX,
+                         const int minY,
+                         const int maxX,
+                         const int maxY,
+                         const int components,
+                         const PixelType type,
+                         void *pixels,
+                         const int kernelSize,
+                         const double sigma)
+{
+  if (kernelSize % 2 != 1)
+  {
+    return false;
+  }
+
+  int margin = (kernelSize - 1) / 2;
+
+  Region region;
+  if (!clipRegion(&region, width, height, minX, minY, maxX, maxY,
+                  components, type, pixels, pixels, margin))
+  {
+    return true;
+  }
+
+  const double *kernel = (const double *) cachedKernel(kernelSize, sigma, KERNEL_1D);
+  float *taps = (float *) malloc(kernelSize * sizeof(float));
+
+  if (kernel == NULL || taps == NULL)
+  {
+    free(taps);
+    return false;
+  }
+
+  for (int i = 0; i < kernelSize; i++)
+  {
+    taps[i] = (float) kernel[i];
+  }
+
+  /* A band per thread, each at least as high as the kernel, such that
+     its edges are only read by the bands either side */
+  int bands = margin > 0 ? region.regionHeight / kernelSize : 1;
+  bands = bands < threadCount() ? bands : threadCount();
+  bands = bands > 1 ? bands : 1;
+
+  InPlaceContext inPlace = { &region, taps, kernelSize,
+                             tapsSymmetric(taps, kernelSize), bands,
+                             NULL, 0, 0, 0, false };
+
+  inPlace.boundaryRows = (bands - 1) * 2 * margin;
+  inPlace.aboveRows = margin > region.y0 ? margin - region.y0 : 0;
+  inPlace.belowRows = region.y1 + margin >= height ? region.y1 + margin - height + 1 : 0;
+
+  int keptRows = inPlace.boundaryRows + inPlace.aboveRows + inPlace.belowRows;
+  inPlace.kept = (float *) malloc(((size_t) keptRows * region.stride + 1) * sizeof(float));
+
+  if (inPlace.kept == NULL)
+  {
+    free(taps);
+    return false;
+  }
+
+  /* All rows kept aside are filtered before any band writes a row */
+  parallelFor(keptRows, filterKept, &inPlace);
+
+  if (!inPlace.failed)
+  {
+    parallelFor(bands, inPlaceBands, &inPlace);
+  }
 
-#define M_PI 3.14159265358979323846
+  free(taps);
+  free(inPlace.kept);
 
+  return !inPlace.failed;
+}
 
-bool convolve(const int width,  
-              const int height,
-              const int minX,
-              const int minY,
-              const int maxX,
-              const int maxY,
-              const int components,
-              const uint8_t *in,
-              uint8_t *out,
-              const double *kernel,
-              const int kernelSize)
-{
 
-  /* Only deal with kernels of odd numbered dimensions */
+bool gaussianBlurStream(const int width,
+                        const int height,
+                        const int minX,
+                        const int minY,
+                        const int maxX,
+                        const int maxY,
+                        const int components,
+                        const PixelType type,
+                        ReadRow read,
+                        void *reader,
+                        WriteRow write,
+                        void *writer,
+                        const int kernelSize,
+                        const double sigma)
+{
   if (kernelSize % 2 != 1)
   {
     return false;
   }
 
-  /* Keep track of current incoming and outgoing pixels */
-  const uint8_t *inPixel = in;
-  uint8_t *outPixel = out;
+  int margin = (kernelSize - 1) / 2;
+  size_t pixelSize = (size_t) components * pixelTypeSize(type);
+  size_t rowSize = (size_t) width * pixelSize;
+
+  /* Rows outside of the rectangle pass straight through; all of them, if
+     it lies outside of the image */
+  Region region;
+  if (!clipRegion(&region, width, height, minX, minY, maxX, maxY,
+                  components, type, NULL, NULL, margin))
+  {
+    region.x0 = region.x1 = 0;
+    region.y0 = height + kernelSize;
+    region.y1 = region.y0;
+    measureRegion(&region);
+  }
+
+  int stride = region.stride;
 
-  int areaSize = maxX - minX;
-  int areaCenter = areaSize / 2;
+  /* Rings of source rows as read, and of the rectangle's part of them as
+     filtered horizontally, each indexed by row modulo kernelSize */
+  uint8_t *raw = (uint8_t *) malloc(kernelSize * rowSize);
+  float *filtered = (float *) malloc((size_t) kernelSize * stride * sizeof(float));
+  float *line = (float *) malloc(region.paddedStride * sizeof(float));
+  float *constant = (float *) malloc(stride * sizeof(float));
+  float *accumulator = (float *) malloc(stride * sizeof(float));
+  uint8_t *blended = (uint8_t *) malloc(rowSize);
+  const double *kernel = (const double *) cachedKernel(kernelSize, sigma, KERNEL_1D);
+  float *taps = (float *) malloc(kernelSize * sizeof(float));
+  const float **rows = (const float **) malloc(kernelSize * sizeof(float *));
 
-  double *kernelIdentity  = (double *) malloc(kernelSize * kernelSize * sizeof(double));
-  double *kernelInterpolated = (double *) malloc(kernelSize * kernelSize * sizeof(double));
+  bool ok = raw != NULL && filtered != NULL && line != NULL && constant != NULL
+    && accumulator != NULL && blended != NULL && kernel != NULL && taps != NULL
+    && rows != NULL;
+  bool symmetric = false;
+
+  if (ok)
+  {
+    for (int i = 0; i < kernelSize; i++)
+    {
+      taps[i] = (float) kernel[i];
+    }
 
-  computeIdentityKernel(kernelIdentity, kernelSize);
+    symmetric = tapsSymmetric(taps, kernelSize);
 
-  int margin = (kernelSize - 1) / 2;
+    for (int i = 0; i < region.paddedStride; i++)
+    {
+      line[i] = borderComponent(type);
+    }
 
-  for (int h = 0; h < height; h++)
+    filterLine(&region, taps, kernelSize, symmetric, line, constant);
+  }
+
+  /* A view of a single row, whose padded row 0 is the row itself */
+  Region view = region;
+  view.height = 1;
+  view.y0 = margin;
+
+  int next = 0;     // rows read so far
+
+  for (int y = 0; ok && y < height; y++)
   {
-    for (int w = 0; w < width; w++ )
+    bool inside = y >= region.y0 && y <= region.y1;
+
+    /* Read ahead as far as the kernel reaches */
+    int last = inside ? y + margin : y;
+    last = last < height - 1 ? last : height - 1;
+
+    for (; ok && next <= last; next++)
     {
+      uint8_t *slot = raw + (size_t) (next % kernelSize) * rowSize;
+      ok = read(reader, slot);
 
-      /* Only convolute area within rectangle */
-      if (w < minX || w > maxX || h < minY || h > maxY)
+      if (ok && next >= region.y0 - margin && next <= region.y1 + margin)
       {
-        for (int c = 0; c < components; c++)
-        {
-          outPixel[c] = inPixel[c];
-        }
+        view.in = slot;
+
+        PaddedContext copy = { &view, line, NULL };
+        copyPaddedRows(&copy, 0, 1);
+
+        filterLine(&region, taps, kernelSize, symmetric, line,
+                   filtered + (size_t) (next % kernelSize) * stride);
+      }
+    }
+
+    const uint8_t *source = raw + (size_t) (y % kernelSize) * rowSize;
+
+    if (!ok || !inside)
+    {
+      ok = ok && write(writer, source);
+      continue;
+    }
+
+    /* Vertical pass; rows beyond the edge must map onto the ring, which
+       they do for all but the wrapping border, or be the constant one */
+    for (int t = 0; ok && t < kernelSize; t++)
+    {
+      int row = borderIndex(y - margin + t, height);
+      rows[t] = constant;
+
+      if (row < 0)
+      {
+        continue;
       }
 
-      /* Convolute area within rectangle */
+      if (row >= next - kernelSize && row < next)
+      {
+        rows[t] = filtered + (size_t) (row % kernelSize) * stride;
+      }
       else
       {
+        ok = false;
+      }
+    }
 
-        int dx = abs(areaCenter - (w - minX));
-        int dy = abs(areaCenter - (h - minY));
-        double v = sqrt(dx * dx + dy * dy);
+    if (ok)
+    {
+      filterColumns(taps, kernelSize, symmetric, rows, accumulator, 0, stride);
 
-        v *= 2;              // radius to diameter
-        v *= 1.0 / areaSize; // fit
-        v = 1 - v;           // inverse
-        v = v > 0 ? v : 0;   // clamp
+      memcpy(blended, source, rowSize);
+      blendRowAt(&region,
+                 source + region.x0 * pixelSize,
+                 blended + region.x0 * pixelSize,
+                 accumulator, y);
 
-        interpolate(
-          v,                       // weight
-          kernelIdentity,          // a
-          kernel,                  // b
-          kernelInterpolated,      // c
-          kernelSize               // size
-        );
+      ok = write(writer, blended);
+    }
+  }
 
-        /* Mix each component separately */
-        for (int component = 0; component < components; component++)
-        {
-          int sum = 0;
+  free(raw);
+  free(filtered);
+  free(line);
+  free(constant);
+  free(accumulator);
+  free(blended);
+  free(taps);
+  free(rows);
 
-          for (int col = 0, i = 0; col < kernelSize; col++)
-          {
-            for (int row = 0; row < kernelSize; row++)
-            {
-              /* Calculate kernel counterpart
+  return ok;
+}
 
-              The counterpart, referred to as "sample", originates at
-              the current pixel component and spans out in every direction
-              until a matrix of equivalent dimension is found. This matrix
-              is then multiplied with the kernel to produce the resuting pixel.
 
-              The origin between the kernel and sample position differ
+int pixelTypeSize(const PixelType type)
+{
+  switch (type)
+  {
+    case PIXEL_U16: return sizeof(uint16_t);
+    case PIXEL_F32: return sizeof(float);
+    default:        return sizeof(uint8_t);
+  }
+}
 
-              kernel          sample
-               ___________     ___________
-              |k  |   |   |   |   |   |   |
-              |___|___|___|   |___|___|___|
-              |   |   |   |   |   |s  |   |
-              |___|___|___|   |___|___|___|
-              |   |   |   |   |   |   |   |
-              |___|___|___|   |___|___|___|
 
-              */
+typedef struct
+{
+  const void *in;
+  PixelType inType;
+  void *out;
+  PixelType outType;
+} ConvertContext;
 
-              const uint8_t *samplePixel = inPixel
-                + (col - margin) * width * components
-                + (row - margin) * components;
 
-              sum += (int) (kernelInterpolated[i] * samplePixel[component]);
+/* Values /p first up to /p last, through a float normalised to 0-1 */
+static void convertValues(void *context, const int first, const int last)
+{
+  ConvertContext *convert = (ConvertContext *) context;
+  float scale = convert->inType == PIXEL_U8 ? 1.0f / 255
+    : convert->inType == PIXEL_U16 ? 1.0f / 65535
+    : 1.0f;
 
-              i++;
-            }
-          }
+  for (int i = first; i < last; i++)
+  {
+    float v = loadComponent(convert->in, i, convert->inType) * scale;
 
-          outPixel[component] = sum;
-        }
-      }
+    switch (convert->outType)
+    {
+      case PIXEL_U8:
+        ((uint8_t *) convert->out)[i] = saturate(v * 255.0);
+        break;
+      case PIXEL_U16:
+        ((uint16_t *) convert->out)[i] = saturate16(v * 65535.0);
+        break;
+      case PIXEL_F32:
+        ((float *) convert->out)[i] = v;
+        break;
+    }
+  }
+}
+
+
+void convertPixels(const void *in,
+                   const PixelType inType,
+                   void *out,
+                   const PixelType outType,
+                   const int count)
+{
+  ConvertContext convert = { in, inType, out, outType };
+  parallelFor(count, convertValues, &convert);
+}
+
+
+typedef struct
+{
+  const uint8_t *interleaved;
+  uint8_t *target;
+  uint8_t *const *planes;
+  const uint8_t *const *sources;
+  int components;
+} LayoutContext;
+
+
+static void splitPixels(void *context, const int first, const int last)
+{
+  LayoutContext *layout = (LayoutContext *) context;
+  fixedPasses()->split(layout->interleaved, layout->planes,
+                       layout->components, first, last);
+}
+
+
+static void mergePixels(void *context, const int first, const int last)
+{
+  LayoutContext *layout = (LayoutContext *) context;
+  fixedPasses()->merge(layout->sources, layout->target,
+                       layout->components, first, last);
+}
+
+
+void deinterleave(const uint8_t *in,
+                  uint8_t *const *planes,
+                  const int count,
+                  const int components)
+{
+  LayoutContext layout = { in, NULL, planes, NULL, components };
+  parallelFor(count, splitPixels, &layout);
+}
+
+
+void interleave(const uint8_t *const *planes,
+                uint8_t *out,
+                const int count,
+                const int components)
+{
+  LayoutContext layout = { NULL, out, NULL, planes, components };
+  parallelFor(count, mergePixels, &layout);
+}
+
+
+bool gaussianBlurPlanar(const int width,
+                        const int height,
+                        const int minX,
+                        const int minY,
+                        const int maxX,
+                        const int maxY,
+                        const int components,
+                        const uint8_t *in,
+                        uint8_t *out,
+                        const int kernelSize,
+                        const double sigma,
+                        const BlurMode mode,
+                        const unsigned channels)
+{
+  if (components > MAX_COMPONENTS)
+  {
+    return false;
+  }
 
-    inPixel += components;
-    outPixel += components;
+  int count = width * height;
+  uint8_t *data = (uint8_t *) malloc((size_t) 2 * count * components * sizeof(uint8_t));
 
+  if (data == NULL)
+  {
+    return false;
+  }
+
+  uint8_t *planes[MAX_COMPONENTS];
+  const uint8_t *results[MAX_COMPONENTS];
+
+  for (int c = 0; c < components; c++)
+  {
+    planes[c] = data + (size_t) c * count;
+  }
+
+  deinterleave(in, planes, count, components);
+
+  /* Channels left out are merged straight from their source plane */
+  bool ok = true;
+  for (int c = 0; c < components && ok; c++)
+  {
+    results[c] = planes[c];
+
+    if (channels & (1u << c))
+    {
+      uint8_t *blurred = data + (size_t) (components + c) * count;
+
+      ok = gaussianBlur(width, height, minX, minY, maxX, maxY,
+                        1, planes[c], blurred, kernelSize, sigma, mode);
+      results[c] = blurred;
     }
   }
-  
-  free(kernelIdentity);
-  free(kernelInterpolated);
 
-  return true;
+  if (ok)
+  {
+    interleave(results, out, count, components);
+  }
+
+  free(data);
+
+  return ok;
 }
 
+
 double computeGaussian(const double x, const double y, const double sigma, const double mean)
 {
     return exp(-0.5 * (pow((x - mean) / sigma, 2.0)
@@ -158,6 +5191,47 @@ double computeKernel(double *out,
     return sum;
 }
 
+double computeKernel1D(double *out,
+                       const int W,
+                       const double sigma)
+{
+    double mean = W / 2,
+           sum = 0.0;
+
+    for (int x = 0; x < W; ++x) {
+        out[x] = exp(-0.5 * pow((x - mean) / sigma, 2.0))
+                    / (sqrt(2 * M_PI) * sigma);
+        sum += out[x];
+    }
+
+    return sum;
+}
+
+double computeKernelAnisotropic(double *out,
+                                const int W,
+                                const double sigmaX,
+                                const double sigmaY,
+                                const double theta)
+{
+    double mean = W / 2,
+           cosine = cos(theta),
+           sine = sin(theta),
+           sum = 0.0;
+
+    for (int y = 0, i = 0; y < W; ++y)
+        for (int x = 0; x < W; ++x) {
+            /* Offset in the frame of the ellipse */
+            double u = (x - mean) * cosine + (y - mean) * sine;
+            double v = (y - mean) * cosine - (x - mean) * sine;
+
+            out[i] = exp(-0.5 * (pow(u / sigmaX, 2.0) + pow(v / sigmaY, 2.0)))
+                        / (2 * M_PI * sigmaX * sigmaY);
+            sum += out[i];
+            i++;
+        }
+
+    return sum;
+}
 
 int normalise(double *out,
               const double sum,
@@ -232,20 +5306,57 @@ void computeRamp(double *out, const int W)
         {
             int deltaX = abs(center - col);
             int deltaY = abs(center - row);
-            double v = sqrt(deltaX * deltaX + deltaY * deltaY);
 
-            v *= 2;              // radius to diameter
-            v *= 1.0 / W;        // fit
-            v = 1 - v;           // inverse
-            v = v > 0 ? v : 0;   // clamp
-
-            out[i] = v;
+            out[i] = falloffAt(FALLOFF_LINEAR, 1, deltaX, deltaY, W, W);
 
             i++;
         }
     }
 }
 
+
+void computeFalloff(double *out,
+                    const Falloff falloff,
+                    const double parameter,
+                    const int width,
+                    const int height)
+{
+    int columns = width / 2 + 2;
+    int rows = height / 2 + 2;
+
+    if (falloff != FALLOFF_GAUSSIAN)
+    {
+        for (int dy = 0, i = 0; dy < rows; dy++)
+        {
+            for (int dx = 0; dx < columns; dx++, i++)
+            {
+                out[i] = falloffAt(falloff, parameter, dx, dy, width, height);
+            }
+        }
+        return;
+    }
+
+    /* exp(-(x^2 + y^2) / 2s^2) is exp(-x^2 / 2s^2) * exp(-y^2 / 2s^2);
+       the first row holds the former, and every row is it scaled by the
+       latter, cut off at the inscribed circle */
+    for (int dx = 0; dx < columns; dx++)
+    {
+        out[dx] = falloffAt(falloff, parameter, dx, 0, width, height);
+    }
+
+    for (int dy = 1; dy < rows; dy++)
+    {
+        double scaleY = falloffAt(falloff, parameter, 0, dy, width, height);
+        double *row = out + (size_t) dy * columns;
+
+        for (int dx = 0; dx < columns; dx++)
+        {
+            bool inside = 4.0 * (dx * dx + dy * dy) < (double) width * width;
+            row[dx] = inside ? out[dx] * scaleY : 0;
+        }
+    }
+}
+
 int interpolate(const double weight,
                 const double *a,
                 const double *b,
@@ -263,48 +5374,141 @@ int interpolate(const double weight,
     return 0;
 }
 
-int scale(const int factor,
-          const uint8_t *in,
-          uint8_t *out,
-          const int width,
-          const int height,
-          const int components)
+typedef struct
 {
-    if (factor == 1)
-    {
-        memcpy(out, in, width * height * components * sizeof(uint8_t));
-        return 0;
-    }
+    int factor;
+    const uint8_t *in;
+    uint8_t *out;
+    int width;
+    int components;
+} ScaleContext;
+
 
-    for (int row = 0, sourceIndex = 0, targetIndex = 0; row < height; row++)
+static void scaleRows(void *context, const int first, const int last)
+{
+    ScaleContext *s = (ScaleContext *) context;
+    int factor = s->factor;
+    int components = s->components;
+    int rowSize = s->width * components;
+
+    for (int row = first; row < last; row++)
     {
-        for (int y = 0; y < factor; y++)
+        const uint8_t *source = s->in + (size_t) row * rowSize;
+        uint8_t *target = s->out + (size_t) row * factor * factor * rowSize;
+
+        for (int y = 0, targetIndex = 0; y < factor; y++)
         {
-            for (int col = 0; col < width; col++)
+            for (int col = 0, sourceIndex = 0; col < s->width; col++)
             {
                 for (int x = 0; x < factor; x++)
                 {
                     for (int c = 0; c < components; c++)
                     {
-                        out[targetIndex] = in[sourceIndex + c];
+                        target[targetIndex] = source[sourceIndex + c];
                         targetIndex++;
                     }
                 }
 
                 sourceIndex += components;
             }
-
-            if (y < factor - 1)
-            {
-                // rewind
-                sourceIndex -= width * components;
-            }
         }
     }
+}
+
+
+int scale(const int factor,
+          const uint8_t *in,
+          uint8_t *out,
+          const int width,
+          const int height,
+          const int components)
+{
+    if (factor == 1)
+    {
+        copyImage(in, out, width, height, components);
+        return 0;
+    }
+
+    /* Each source row becomes /p factor rows, in bands */
+    ScaleContext s = { factor, in, out, width, components };
+    parallelFor(height, scaleRows, &s);
+
+    return 0;
+}
+
+
+int scaleFiltered(const int factor,
+                  const uint8_t *in,
+                  uint8_t *out,
+                  const int width,
+                  const int height,
+                  const int components)
+{
+    if (factor < 1 || (factor & (factor - 1)) != 0)
+    {
+        return 1;
+    }
+
+    int count = width * height * components;
+    size_t size = (size_t) count * factor * factor;
+    float *front = (float *) malloc(size * sizeof(float));
+    float *back = (float *) malloc(size * sizeof(float));
+    float *scratch = (float *) malloc(size * sizeof(float));
+
+    if (front == NULL || back == NULL || scratch == NULL)
+    {
+        free(front);
+        free(back);
+        free(scratch);
+        return 1;
+    }
+
+    /* Doubled as many times as it takes, as a pyramid expands a level */
+    convertPixels(in, PIXEL_U8, front, PIXEL_F32, count);
+
+    for (int f = 1; f < factor; f *= 2)
+    {
+        resample(front, back, scratch, width * f, height * f,
+                 width * f * 2, height * f * 2, components, false);
+
+        float *swap = front;
+        front = back;
+        back = swap;
+    }
+
+    convertPixels(front, PIXEL_F32, out, PIXEL_U8, (int) size);
+
+    free(front);
+    free(back);
+    free(scratch);
 
     return 0;
 }
 
+
+typedef struct
+{
+    double *in;
+    int height;
+    double offset;
+    double factor;
+} FitContext;
+
+
+static void fitColumns(void *context, const int first, const int last)
+{
+    FitContext *f = (FitContext *) context;
+
+    for (int x = first, i = first * f->height; x < last; ++x)
+        for (int y = 0; y < f->height; ++y)
+        {
+            f->in[i] += f->offset;
+            f->in[i] *= f->factor;
+            i++;
+        }
+}
+
+
 int fit(double *in,
         const int width,
         const int height,
@@ -313,13 +5517,8 @@ int fit(double *in,
         const double newMin, // e.g. 0
         const double newMax) // e.g. 255
 {
-    for (int x = 0, i = 0; x < width; ++x) 
-        for (int y = 0; y < height; ++y)
-        {
-            in[i] += newMin - oldMin;
-            in[i] *= newMax / oldMax;
-            i++;
-        }
+    FitContext f = { in, height, newMin - oldMin, newMax / oldMax };
+    parallelFor(width, fitColumns, &f);
 
     return 0;
 }
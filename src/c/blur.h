@@ -3,6 +3,106 @@
 #include <stdint.h>
 
 
+/** Strategy by which gaussianBlur() evaluates its kernel
+ */
+typedef enum
+{
+  BLUR_DIRECT,       // convolve(), kernelSize * kernelSize taps per pixel
+  BLUR_SEPARABLE,    // convolveSeparable(), 2 * kernelSize taps per pixel
+  BLUR_BOX,          // boxBlur(), constant cost regardless of sigma
+  BLUR_IIR,          // iirBlur(), constant cost regardless of sigma
+  BLUR_FFT,          // convolveFFT(), cost independent of kernelSize
+  BLUR_FIXED,        // convolveSeparableFixed(), integer arithmetic
+  BLUR_INTERPOLATED, // convolveInterpolated(), kernel rebuilt per pixel
+  BLUR_PYRAMID,      // pyramidBlur(), for very large sigmas
+  BLUR_AUTO          // iirBlur() for large sigmas, else convolveSeparableFixed()
+} BlurMode;
+
+
+/** Type of each component of an image
+ */
+typedef enum
+{
+  PIXEL_U8,         // 0-255, as of stbi_load()
+  PIXEL_U16,        // 0-65535, e.g. 16-bit scans
+  PIXEL_F32         // unbounded, as of stbi_loadf(), e.g. HDR plates
+} PixelType;
+
+
+/** Samples taken beyond the edge of the image, see setBorder()
+ */
+typedef enum
+{
+  BORDER_CLAMP,      // nearest edge pixel (default)
+  BORDER_MIRROR,     // reflected about the edge pixel
+  BORDER_WRAP,       // from the opposite edge
+  BORDER_CONSTANT    // a constant value
+} BorderMode;
+
+
+/** Curve of the weight of the blur from the center of the rectangle to
+ *  its edge, see setFalloff(); r is the distance to the center over the
+ *  radius, and every curve is 0 from r = 1 on
+ */
+typedef enum
+{
+  FALLOFF_LINEAR,     // 1 - r, the radial ramp (default)
+  FALLOFF_SMOOTHSTEP, // 3t^2 - 2t^3 of t = 1 - r, flat at center and edge
+  FALLOFF_GAMMA,      // (1 - r)^parameter
+  FALLOFF_GAUSSIAN,   // exp(-r^2 / (2 parameter^2)), cut off at r = 1
+  FALLOFF_ELLIPTICAL  // 1 - r, of the ellipse inscribed in the rectangle
+} Falloff;
+
+
+/** Rectangle of gaussianBlurAreas(), as passed to convolve()
+ */
+typedef struct
+{
+  int minX;
+  int minY;
+  int maxX;
+  int maxY;
+} Area;
+
+
+/** Pixels of an arbitrary region, as runs of each row; see setShape()
+ *
+ *   row h:   ..####.....###..    runs[2 * i] up to runs[2 * i + 1],
+ *              ^   ^    ^  ^     for i of rows[h] up to rows[h + 1]
+ *
+ * Runs of a row are sorted, and neither overlap nor touch.
+ */
+typedef struct
+{
+  int width;          // of image
+  int height;         //
+  int *rows;          // height + 1 indices of the first run of each row
+  int *runs;          // first column of each run, and the one past its last
+} Shape;
+
+
+/** Instruction sets of which the fixed-point engines have variants
+ */
+typedef enum
+{
+  SIMD_NONE,        // scalar, portable C
+  SIMD_SSE41,
+  SIMD_AVX2
+} InstructionSet;
+
+
+/** Variants of a gaussian kernel held by the kernel cache, see cachedKernel()
+ */
+typedef enum
+{
+  KERNEL_1D,        // kernelSize doubles, as of computeKernel1D(), normalised
+  KERNEL_2D,        // kernelSize * kernelSize doubles, as of computeKernel()
+  KERNEL_FIXED_1D,  // KERNEL_1D as int16_t, as of quantiseKernel()
+  KERNEL_FIXED_2D,  // KERNEL_2D as int16_t, as of quantiseKernel()
+  KERNEL_IDENTITY   // as of computeIdentityKernel(), regardless of sigma
+} KernelType;
+
+
 /** 2d convolution filter
  *
  * Pixeldata is in the stb_image.h format; i.e. *y scanlines of *x pixels,
@@ -16,9 +116,15 @@
  * @param out           Pointer to where pixels is written
  * @param kernel        Matrix which to apply to pixel data
  * @param kernelSize    Width and height of kernel
- * @param mask          Multiply the effect
  * @returns             true if successful
  *
+ * Within the rectangle, pixels are mixed with the kernel by a radial
+ * falloff; 1 at its center and 0 at its inscribed circle. As convolution
+ * is linear, the rectangle is blurred once and each pixel then mixed with
+ * the source by its falloff, rather than mixing the kernel itself with
+ * the identity kernel per pixel; see convolveInterpolated(). Samples
+ * outside of the image are taken as per setBorder().
+ *
  * Reference:
  *  - http://setosa.io/ev/image-kernels/
  *  - https://docs.gimp.org/en/plug-in-convmatrix.html
@@ -38,6 +144,913 @@ bool convolve(const int width,        // width of image
               const int kernelSize);  // size of (square) kernel
 
 
+/** Per-pixel kernel interpolation
+ *
+ * Same contract as convolve(), but rather than blurring the rectangle
+ * once, each pixel interpolates between the identity kernel and
+ * /p kernel by its falloff and convolves with the result. Kept as a
+ * reference; it costs an extra kernelSize * kernelSize operations per
+ * pixel and truncates each tap to an integer.
+ *
+ * @returns             true if successful
+ */
+bool convolveInterpolated(const int width,
+                          const int height,
+                          const int minX,
+                          const int minY,
+                          const int maxX,
+                          const int maxY,
+                          const int components,
+                          const uint8_t *in,
+                          uint8_t *out,
+                          const double *kernel,
+                          const int kernelSize);
+
+
+/** Separable 2d convolution filter
+ *
+ * Same contract as convolve(), but /p kernel is the 1d kernel from
+ * computeKernel1D() and is applied as a horizontal pass followed by
+ * a vertical pass; cost per pixel grows with kernelSize rather than
+ * kernelSize * kernelSize.
+ *
+ *   ___________       _           ___________
+ *  |_|_|_|_|_|_|     |_|         |           |
+ *                 +  |_|    =    |     o     |
+ *                    |_|         |           |
+ *                    |_|         |___________|
+ *
+ * The rectangle is blurred once and then mixed with the source by the
+ * same radial falloff as convolve(), which is equivalent to mixing the
+ * kernel with its identity per pixel. Samples outside of the image are
+ * taken as per setBorder().
+ *
+ * @param kernel        1d kernel, of length /p kernelSize
+ * @returns             true if successful
+ */
+bool convolveSeparable(const int width,
+                       const int height,
+                       const int minX,
+                       const int minY,
+                       const int maxX,
+                       const int maxY,
+                       const int components,
+                       const uint8_t *in,
+                       uint8_t *out,
+                       const double *kernel,
+                       const int kernelSize);
+
+
+/** Box blur cascade
+ *
+ * Approximates a gaussian of /p sigma by three stacked box blurs, each
+ * evaluated as a running sum along rows and then along columns. Cost
+ * per pixel is independent of /p sigma.
+ *
+ *   _____         _____         _____          ___
+ *  |     |   *   |     |   *   |     |   ~   _/   \_
+ *  |     |       |     |       |     |     _/       \_
+ *
+ * Box widths are odd and chosen such that the variance of the cascade
+ * is as close to sigma^2 as whole widths allow. Against the untruncated
+ * gaussian, i.e. computeKernel() with a kernelSize of 6 * sigma or more,
+ * 8-bit results differ by at most 4 levels and by less than 0.2 levels on
+ * average for sigma 3-50. Below that, boxes are only a few pixels wide
+ * and hard edges may differ by up to 15 levels at sigma 1. Smaller
+ * kernelSizes truncate the reference and differ accordingly.
+ *
+ * Mixing with the source and edge handling is as convolveSeparable().
+ *
+ * @returns             true if successful
+ */
+bool boxBlur(const int width,
+             const int height,
+             const int minX,
+             const int minY,
+             const int maxX,
+             const int maxY,
+             const int components,
+             const uint8_t *in,
+             uint8_t *out,
+             const double sigma);
+
+
+/** Recursive gaussian
+ *
+ * Approximates a gaussian of /p sigma by a third-order recursive filter,
+ * run forwards and then backwards along each row and each column. Every
+ * component of the interleaved pixel data is filtered independently.
+ * Cost per pixel is independent of /p sigma.
+ *
+ *   ---->  causal       \
+ *   <----  anti-causal   >  per row, then per column
+ *                       /
+ *
+ * Coefficients are those of Young & van Vliet. Against computeKernel()
+ * with a kernelSize of 6 * sigma or more, 8-bit results differ by at most
+ * 5 levels and by less than 0.3 levels on average for sigma 3 and up, and
+ * by at most 2 levels from sigma 20. This is what lets gaussianBlur() swap
+ * it in automatically for BLUR_AUTO. Smaller sigmas are less accurate.
+ *
+ * Mixing with the source and edge handling is as convolveSeparable().
+ *
+ * @returns             true if successful
+ */
+bool iirBlur(const int width,
+             const int height,
+             const int minX,
+             const int minY,
+             const int maxX,
+             const int maxY,
+             const int components,
+             const uint8_t *in,
+             uint8_t *out,
+             const double sigma);
+
+
+/** Gaussian pyramid
+ *
+ * Halves the rectangle and its padding by the 5-tap binomial as many
+ * times as /p sigma allows, blurs the coarsest level as iirBlur() does,
+ * and doubles it back up level by level by the same binomial. Each level
+ * holds a quarter of the pixels of the one above it, such that nearly
+ * all of the work is that of halving and doubling.
+ *
+ *   ______
+ *  |      |  ----> ___   ----> _         blur
+ *  |      |       |   |       |_|  ---->  _
+ *  |______|  <----|___|  <---------------|_|
+ *
+ * Halving and doubling a level each add a variance of 1 in its own
+ * pixels, which is taken off of what is left for the coarsest level,
+ * where at least 2 pixels of sigma remain. There are no levels below a
+ * sigma of about 4.5, where this is iirBlur().
+ *
+ * Against a gaussian out to 4 sigma, 8-bit results differ by at most
+ * 3 levels and by 0.1 levels on average for sigma 25, and by at most
+ * 2 levels from sigma 50; about twice the error of iirBlur().
+ *
+ * Mixing with the source and edge handling is as convolveSeparable().
+ *
+ * @returns             true if successful
+ */
+bool pyramidBlur(const int width,
+                 const int height,
+                 const int minX,
+                 const int minY,
+                 const int maxX,
+                 const int maxY,
+                 const int components,
+                 const uint8_t *in,
+                 uint8_t *out,
+                 const double sigma);
+
+
+/** Blur of a sigma of its own per pixel, e.g. depth of field
+ *
+ * Each pixel is averaged over a box as wide as its value of /p map calls
+ * for, of a summed-area table computed once per pass, such that a box
+ * costs four lookups whatever its width:
+ *
+ *    a ______ b
+ *     |      |      sum = d - b - c + a
+ *     |______|
+ *    c        d
+ *
+ * A single pass is a box per pixel; each further pass boxes the result
+ * of the one before, and 3 approximate a gaussian as boxBlur() does, with
+ * widths picked the same way. A map of 255 throughout is close to
+ * boxBlur() of /p maxSigma, rather than lerping between the source and
+ * a single kernel as convolveInterpolated() does.
+ *
+ * The map takes the place of the falloff, as well as of any mask or
+ * shape; pixels mapped at 0 are left as is. Edge handling is as
+ * convolveSeparable().
+ *
+ * @param map           width * height values; 255 blurs by /p maxSigma
+ * @param maxSigma      sigma of pixels mapped at 255, scaled linearly
+ * @param passes        boxes per pixel, 1-5
+ * @returns             true if successful
+ */
+bool variableBlur(const int width,
+                  const int height,
+                  const int minX,
+                  const int minY,
+                  const int maxX,
+                  const int maxY,
+                  const int components,
+                  const PixelType type,
+                  const void *in,
+                  void *out,
+                  const uint8_t *map,
+                  const double maxSigma,
+                  const int passes);
+
+
+/** Anisotropic gaussian
+ *
+ * Blurs by a gaussian of /p sigmaX along an axis at /p theta radians
+ * from the x axis, towards the y axis, and of /p sigmaY across it. Rather
+ * than a dense kernel of which most taps are near 0, it runs a pass
+ * along rows or columns and then one along a line sheared off the other
+ * axis, through which the covariance of the ellipse is split exactly.
+ *
+ *   ___________        /          ___________
+ *  |_|_|_|_|_|_|      /          |     _     |
+ *                 +  /     =     |   /  /    |
+ *                   /            |  /_/      |
+ *                  /             |___________|
+ *
+ * Of the two ways to split it, that which shears the line by no more
+ * than a pixel per tap is taken. Samples of the sheared line are
+ * interpolated between neighbouring pixels, which adds variance along
+ * the first pass; that pass makes up for it by as much less of its own.
+ * Either pass reaches out to 4 sigma, such that cost per pixel grows
+ * with sigmaX and sigmaY, rather than with their product.
+ *
+ * Mixing with the source and edge handling is as convolveSeparable().
+ *
+ * Reference:
+ *  - Geusebroek, Smeulders & van de Weijer, "Fast anisotropic Gauss
+ *    filtering", IEEE Transactions on Image Processing 12(8), 2003
+ *
+ * @returns             true if successful
+ */
+bool anisotropicBlur(const int width,
+                     const int height,
+                     const int minX,
+                     const int minY,
+                     const int maxX,
+                     const int maxY,
+                     const int components,
+                     const PixelType type,
+                     const void *in,
+                     void *out,
+                     const double sigmaX,
+                     const double sigmaY,
+                     const double theta);
+
+
+/** Fourier transform of the rectangle of an image
+ *
+ * Computed once by computeSpectrum() and reused by convolveSpectrum()
+ * for any number of kernels up to /p maxKernelSize.
+ */
+typedef struct
+{
+  int width;          // of image
+  int height;         // of image
+  int components;     // of image
+  PixelType type;     // of image
+  int minX;           // rectangle, as passed to convolve()
+  int minY;           //
+  int maxX;           //
+  int maxY;           //
+  int maxKernelSize;  // largest kernel the padding accommodates
+  int size[2];        // dimensions of transform, powers of two
+  double *data;       // per component, size[1] rows of size[0] / 2 + 1 complex
+} Spectrum;
+
+
+/** Compute the spectrum of a rectangle
+ *
+ * The rectangle is padded by half of /p maxKernelSize on every side,
+ * sampled as per setBorder(), and each component is transformed
+ * separately.
+ *
+ *    ______________
+ *   |   ________   |
+ *   |  |        |  |  ---> fftReal2D()
+ *   |  |  rect  |  |
+ *   |  |________|  |
+ *   |______________|
+ *
+ * @returns     spectrum to be released with freeSpectrum(), or NULL
+ */
+Spectrum *computeSpectrum(const int width,
+                          const int height,
+                          const int minX,
+                          const int minY,
+                          const int maxX,
+                          const int maxY,
+                          const int components,
+                          const uint8_t *in,
+                          const int maxKernelSize);
+
+
+/** Convolve a precomputed spectrum
+ *
+ * Same as convolve(), with /p in being the image from which /p spectrum
+ * was computed. Only the kernel is transformed, such that sweeping many
+ * kernels over the same image transforms the image only once.
+ *
+ * @param kernel        Matrix of any values, of at most maxKernelSize
+ * @returns             true if successful
+ */
+bool convolveSpectrum(const Spectrum *spectrum,
+                      const uint8_t *in,
+                      uint8_t *out,
+                      const double *kernel,
+                      const int kernelSize);
+
+
+void freeSpectrum(Spectrum *spectrum);
+
+
+/** Frequency-domain 2d convolution filter
+ *
+ * Same contract as convolve(), by way of computeSpectrum() and
+ * convolveSpectrum(). Cost is independent of kernelSize, which makes
+ * it the fastest way of applying large kernels that are not separable.
+ */
+bool convolveFFT(const int width,
+                 const int height,
+                 const int minX,
+                 const int minY,
+                 const int maxX,
+                 const int maxY,
+                 const int components,
+                 const uint8_t *in,
+                 uint8_t *out,
+                 const double *kernel,
+                 const int kernelSize);
+
+
+/** Quantise a normalised kernel to fixed point
+ *
+ * Weights are rounded to /p shift bits of fraction, and the center
+ * weight, i.e. out[count / 2], absorbs the rounding error such that
+ * the weights sum to exactly 1 << shift.
+ *
+ * @param count   number of weights; kernelSize or kernelSize * kernelSize
+ * @param shift   bits of fraction, at most 14 for weights of up to 1.0
+ * @returns       0 for success, 1 if weights do not fit in 16 bits
+ */
+int quantiseKernel(const double *kernel,
+                   int16_t *out,
+                   const int count,
+                   const int shift);
+
+
+/** Fixed-point 2d convolution filter
+ *
+ * Same contract as convolve(), evaluated in integers. Weights are
+ * quantised by quantiseKernel() and products accumulated in 32 bits,
+ * then rounded to nearest and saturated to 0-255, rather than being
+ * truncated tap by tap.
+ */
+bool convolveFixed(const int width,
+                   const int height,
+                   const int minX,
+                   const int minY,
+                   const int maxX,
+                   const int maxY,
+                   const int components,
+                   const uint8_t *in,
+                   uint8_t *out,
+                   const double *kernel,
+                   const int kernelSize);
+
+
+/** Fixed-point separable 2d convolution filter
+ *
+ * Same contract as convolveSeparable(), evaluated as convolveFixed().
+ * The horizontal pass is kept in 16 bits with 7 bits of fraction.
+ */
+bool convolveSeparableFixed(const int width,
+                            const int height,
+                            const int minX,
+                            const int minY,
+                            const int maxX,
+                            const int maxY,
+                            const int components,
+                            const uint8_t *in,
+                            uint8_t *out,
+                            const double *kernel,
+                            const int kernelSize);
+
+
+/** Gaussian kernel of the shared kernel cache
+ *
+ * Kernels are computed on first use and kept for the life of the
+ * process, so engines called over and over with the same few kernelSize
+ * and sigma pairs no longer evaluate exp() per tap per call. The cache
+ * is safe to use from any thread; kernels it returns are never changed.
+ *
+ *   (kernelSize, sigma, type) --> [ 1d | 2d | fixed 1d | fixed 2d ]
+ *
+ * @param kernelSize  width and height of kernel; odd
+ * @param sigma       standard deviation, ignored for KERNEL_IDENTITY
+ * @returns           double or int16_t weights as of /p type, or NULL if
+ *                    out of memory or weights do not fit in 16 bits
+ */
+const void *cachedKernel(const int kernelSize,
+                         const double sigma,
+                         const KernelType type);
+
+
+/** Compute all variants of a kernel up front
+ *
+ * Such that the first blur of a server or batch does not pay for them.
+ *
+ * @returns  false if any variant could not be computed
+ */
+bool preloadKernel(const int kernelSize, const double sigma);
+
+
+/** Weights of a falloff of the shared cache
+ *
+ * Engines look up the table of their rectangle once per call, rather
+ * than taking a sqrt() per pixel, and a rectangle of the same size on
+ * the next frame finds it again. The table covers a quadrant, as every
+ * curve is symmetric about the center of the rectangle:
+ *
+ *    center
+ *      x------> dx        weight = table[dy * (width / 2 + 2) + dx]
+ *      |
+ *      v dy               (height / 2 + 2) rows
+ *
+ * Weights beyond the table are 0. Tables too large, or beyond the
+ * number the cache holds, are not kept; NULL is returned for those and
+ * weights are then evaluated per pixel.
+ *
+ * @param falloff    curve, as of setFalloff()
+ * @param parameter  of curve, ignored by those taking none
+ * @param width      of rectangle, maxX - minX
+ * @param height     of curve; width unless FALLOFF_ELLIPTICAL
+ * @returns          weights between 0-1, or NULL
+ */
+const double *cachedFalloff(const Falloff falloff,
+                            const double parameter,
+                            const int width,
+                            const int height);
+
+
+/** Free all kernels and falloff tables of the cache
+ *
+ * Only while no engine runs, as kernels returned earlier are freed too.
+ */
+void clearKernelCache(void);
+
+
+/** Select the best instruction set supported by the running cpu
+ *
+ * Called once at startup; engines otherwise call it on first use.
+ *
+ * @returns      the instruction set selected
+ */
+InstructionSet detectInstructionSet(void);
+
+
+/** Select an instruction set other than the best
+ *
+ * All instruction sets produce identical results.
+ *
+ * @returns      false if not supported by the running cpu
+ */
+bool selectInstructionSet(const InstructionSet set);
+
+
+/** Set the number of threads of the shared pool
+ *
+ * Engines split their rows into bands and run them on the pool; output
+ * is identical for any number of threads.
+ *
+ * @param count  threads, including the calling thread; 0 for one per cpu
+ * @returns      false if threads could not be started, or the pool is busy
+ */
+bool setThreadCount(const int count);
+
+
+/** Number of threads of the shared pool, including the calling thread
+ */
+int threadCount(void);
+
+
+/** Set the side of the tiles the separable and fixed-point engines work in
+ *
+ * Each tile is read along with a halo of half the kernel size on every
+ * side, and all passes over it complete before the next tile, such that
+ * its working set stays in cache however wide the image.
+ *
+ *  ___________________
+ * |  ___________      |
+ * | |   halo    |     |
+ * | |  _______  |     |
+ * | | |       | |     |
+ * | | | tile  | |     |
+ * | | |_______| |     |
+ * | |___________|     |
+ * |___________________|
+ *
+ * By default, a tile and its halo fill half of the second level cache.
+ * Tiles are made smaller still if there are fewer than threads of the pool.
+ * Output is identical for any tile size.
+ *
+ * @param size   pixels along either side; 0 to derive it from the cache
+ */
+void setTileSize(const int size);
+
+
+/** Set how engines sample beyond the edge of the image
+ *
+ * Only pixels whose kernel reaches beyond the edge are affected; those
+ * of the interior read the image directly, with no check per sample.
+ *
+ *    mirror        wrap          constant
+ *  c b | a b c   b c | a b c   k k | a b c
+ *
+ * Applies to all engines; convolveSpectrum() to spectra computed after.
+ *
+ * @param mode   border mode
+ * @param value  every component of samples of BORDER_CONSTANT
+ */
+void setBorder(const BorderMode mode, const uint8_t value);
+
+
+/** Set the weight of the blur per pixel, in place of the radial ramp
+ *
+ * The mask is a plane of one byte per pixel of the image, of the same
+ * width and height, where 0 leaves a pixel as is and 255 replaces it
+ * with its blurred value.
+ *
+ *    ramp          mask
+ *   . : : .       . . # #
+ *   : # # :       . # # #
+ *   : # # :       . . # .
+ *   . : : .       . . . .
+ *
+ * Pixels outside of the rectangle passed to an engine are left as is
+ * either way; see maskBounds() for a rectangle that covers the mask.
+ * Tiles the mask weighs at 0 throughout are not blurred at all.
+ *
+ * @param mask   width * height weights, or NULL for the radial ramp
+ */
+void setMask(const uint8_t *mask);
+
+
+/** Set the curve by which the blur falls off towards the edge of the
+ *  rectangle, where no mask is set
+ *
+ *    linear      smoothstep    gamma 2     gaussian 0.4
+ *   1 \          1 -.          1 \          1 -.
+ *      \             \            \            '.
+ *   0   \___     0    '-___   0   '-.___   0    '-___
+ *     0    r 1     0    r 1     0    r 1      0    r 1
+ *
+ * FALLOFF_ELLIPTICAL follows the rectangle rather than its inscribed
+ * circle, for areas that are not square. Weights are looked up from
+ * tables of cachedFalloff(), such that no curve costs more than another.
+ *
+ * @param falloff    curve
+ * @param parameter  exponent of FALLOFF_GAMMA, or standard deviation of
+ *                   FALLOFF_GAUSSIAN relative to the radius; ignored
+ *                   by the others
+ * @returns          false, keeping the curve as is, if /p parameter is
+ *                   not above 0 where used
+ */
+bool setFalloff(const Falloff falloff, const double parameter);
+
+
+/** Smallest rectangle holding every pixel of a mask that is not 0
+ *
+ * @param minX    inclusive, as passed to convolve()
+ * @param maxX    inclusive
+ * @returns       false if the mask is 0 throughout
+ */
+bool maskBounds(const uint8_t *mask,
+                const int width,
+                const int height,
+                int *minX,
+                int *minY,
+                int *maxX,
+                int *maxY);
+
+
+/** Set the pixels to blur, in place of the mask and the radial ramp
+ *
+ * Pixels of the runs of /p shape are replaced with their blurred value
+ * and all others left as is. Engines only blur the runs of each row, so
+ * that the cost of a region follows the pixels it covers rather than
+ * its bounds; see shapeBounds() for the rectangle to pass.
+ *
+ *    ramp          shape
+ *   . : : .       . # # .
+ *   : # # :       # # # .
+ *   : # # :       . # . .
+ *   . : : .       . . . #
+ *
+ * @param shape  of the same width and height as the image, or NULL
+ */
+void setShape(const Shape *shape);
+
+
+/** Shape of the pixels of a mask that are not 0
+ *
+ * @returns  shape to be released with freeShape(), or NULL
+ */
+Shape *shapeFromMask(const uint8_t *mask, const int width, const int height);
+
+
+/** Shape of the union of circles
+ *
+ * Covers each pixel whose center lies within any of the circles.
+ *
+ * @param circles  x, y and radius of each circle
+ * @param count    circles
+ * @returns        shape to be released with freeShape(), or NULL
+ */
+Shape *shapeFromCircles(const double *circles,
+                        const int count,
+                        const int width,
+                        const int height);
+
+
+/** Shape of a polygon
+ *
+ * Covers each pixel whose center lies within the polygon, by the
+ * even-odd rule, such that a polygon crossing itself leaves holes.
+ *
+ * @param points  x and y of each vertex, the last joined to the first
+ * @param count   vertices
+ * @returns       shape to be released with freeShape(), or NULL
+ */
+Shape *shapeFromPolygon(const double *points,
+                        const int count,
+                        const int width,
+                        const int height);
+
+
+/** Shape covering the pixels of either of two shapes
+ *
+ * @returns  shape to be released with freeShape(), or NULL if the shapes
+ *           differ in width or height
+ */
+Shape *shapeUnion(const Shape *a, const Shape *b);
+
+
+/** Smallest rectangle holding every run of a shape
+ *
+ * @param minX    inclusive, as passed to convolve()
+ * @param maxX    inclusive
+ * @returns       false if the shape is empty
+ */
+bool shapeBounds(const Shape *shape,
+                 int *minX,
+                 int *minY,
+                 int *maxX,
+                 int *maxY);
+
+
+void freeShape(Shape *shape);
+
+
+/** Gaussian blur
+ *
+ * Computes the kernel for /p sigma and /p kernelSize and applies it to
+ * the rectangle by way of /p mode; see convolve() for arguments.
+ *
+ * @param sigma         Standard deviation of gaussian
+ * @param mode          Strategy used to evaluate the kernel
+ * @returns             true if successful
+ */
+bool gaussianBlur(const int width,
+                  const int height,
+                  const int minX,
+                  const int minY,
+                  const int maxX,
+                  const int maxY,
+                  const int components,
+                  const uint8_t *in,
+                  uint8_t *out,
+                  const int kernelSize,
+                  const double sigma,
+                  const BlurMode mode);
+
+
+/** Gaussian blur of 16-bit or float images
+ *
+ * As gaussianBlur(), with components of /p type. Engines run on floats
+ * throughout, converting each sample once as the rectangle and its
+ * padding are read, and rounding and clamping to the range of /p type
+ * once as the result is written; float results are not clamped.
+ *
+ * The fixed-point engines only have the headroom for 8 bits, so
+ * BLUR_FIXED, and BLUR_AUTO where it would pick it, use
+ * convolveSeparable() instead. BLUR_INTERPOLATED is 8-bit only.
+ *
+ * @param type          Type of components of /p in and /p out
+ * @returns             true if successful
+ */
+bool gaussianBlurTyped(const int width,
+                       const int height,
+                       const int minX,
+                       const int minY,
+                       const int maxX,
+                       const int maxY,
+                       const int components,
+                       const PixelType type,
+                       const void *in,
+                       void *out,
+                       const int kernelSize,
+                       const double sigma,
+                       const BlurMode mode);
+
+
+/** Gaussian blur of many rectangles at once
+ *
+ * As gaussianBlurTyped(), over each of /p areas with a falloff of its
+ * own. The image is copied into /p out once for all of them, and areas
+ * that overlap are merged, such that the pixels they share are blurred
+ * once and take the strongest falloff of the areas covering them.
+ *
+ *    areas           merged
+ *   ___              _______
+ *  |  _|__          |       |
+ *  |_|_|  |   --->  |       |     ___
+ *    |____|   ___   |_______|    |   |
+ *            |   |                |___|
+ *            |___|
+ *
+ * The cost is that of a single copy of the image, plus that of blurring
+ * the merged rectangles; not that of a call per area.
+ *
+ * @param areas         rectangles to blur, in any order
+ * @param count         of /p areas
+ * @returns             true if successful
+ */
+bool gaussianBlurAreas(const int width,
+                       const int height,
+                       const Area *areas,
+                       const int count,
+                       const int components,
+                       const PixelType type,
+                       const void *in,
+                       void *out,
+                       const int kernelSize,
+                       const double sigma,
+                       const BlurMode mode);
+
+
+/** Gaussian blur of a rectangle, in place
+ *
+ * As gaussianBlurTyped() with BLUR_SEPARABLE, reading from and writing
+ * to /p pixels. Only the rectangle and the halo around it are touched;
+ * there is no second image and nothing outside of the rectangle is
+ * copied.
+ *
+ * Rows stream through a ring of /p kernelSize rows of the width of the
+ * rectangle, which holds the source of rows already written back. The
+ * rectangle is split into a band per thread, and the rows either side
+ * of each boundary between bands are filtered up front.
+ *
+ *    _________________
+ *   |    ________     |
+ *   |   |  band  |    |
+ *   |   |========|    |  <- 2 * (kernelSize / 2) rows kept aside
+ *   |   |  band  |    |
+ *   |   |________|    |
+ *   |_________________|
+ *
+ * Memory is in the order of the rectangle's width times /p kernelSize
+ * per thread, however large the image.
+ *
+ * @param pixels        image, blurred in place
+ * @returns             true if successful
+ */
+bool gaussianBlurInPlace(const int width,
+                         const int height,
+                         const int minX,
+                         const int minY,
+                         const int maxX,
+                         const int maxY,
+                         const int components,
+                         const PixelType type,
+                         void *pixels,
+                         const int kernelSize,
+                         const double sigma);
+
+
+/** Read the next row of an image into /p row, for gaussianBlurStream()
+ */
+typedef bool (*ReadRow)(void *reader, void *row);
+
+
+/** Write the next row of an image from /p row, for gaussianBlurStream()
+ */
+typedef bool (*WriteRow)(void *writer, const void *row);
+
+
+/** Gaussian blur of an image streamed a row at a time
+ *
+ * As gaussianBlurTyped() with BLUR_SEPARABLE, where rows are pulled from
+ * /p read in order and each is pushed to /p write as soon as it is done.
+ * Only as many rows as the kernel reaches are held at any one time.
+ *
+ *   read        ring          write
+ *   ---->  | y + margin |
+ *          |    ...     |
+ *          |     y      |  ---->
+ *          |    ...     |
+ *          | y - margin |
+ *
+ * Memory is in the order of /p width times /p kernelSize, whatever the
+ * height. BORDER_WRAP reads rows from the far end of the image, which
+ * are long gone, and fails if the rectangle is within reach of the top
+ * or bottom.
+ *
+ * @param read          called once per row, top to bottom
+ * @param reader        passed to /p read
+ * @param write         called once per row, top to bottom
+ * @param writer        passed to /p write
+ * @returns             true if successful; false if either callback
+ *                      fails, after which neither is called again
+ */
+bool gaussianBlurStream(const int width,
+                        const int height,
+                        const int minX,
+                        const int minY,
+                        const int maxX,
+                        const int maxY,
+                        const int components,
+                        const PixelType type,
+                        ReadRow read,
+                        void *reader,
+                        WriteRow write,
+                        void *writer,
+                        const int kernelSize,
+                        const double sigma);
+
+
+/** Bytes of a component of /p type
+ */
+int pixelTypeSize(const PixelType type);
+
+
+/** Convert /p count components from one type to another
+ *
+ * Integer types map their full range to 0-1 as float, and floats are
+ * clamped to 0-1 on their way to integers.
+ */
+void convertPixels(const void *in,
+                   const PixelType inType,
+                   void *out,
+                   const PixelType outType,
+                   const int count);
+
+
+/** Split interleaved pixels into one contiguous plane per component
+ *
+ *   in        r g b r g b r g b ..
+ *   planes[0] r r r ..
+ *   planes[1] g g g ..
+ *   planes[2] b b b ..
+ *
+ * Engines take a plane as an image of 1 component, such that their
+ * vector loads hold a single channel and channels may be skipped.
+ *
+ * @param in            /p count pixels of /p components each
+ * @param planes        one plane of /p count values per component
+ */
+void deinterleave(const uint8_t *in,
+                  uint8_t *const *planes,
+                  const int count,
+                  const int components);
+
+
+/** Merge one plane per component into interleaved pixels; the inverse
+ *  of deinterleave()
+ */
+void interleave(const uint8_t *const *planes,
+                uint8_t *out,
+                const int count,
+                const int components);
+
+
+/** Gaussian blur, per plane
+ *
+ * As gaussianBlur(), but the image is split into planes and each of
+ * /p channels blurred on its own; others pass through untouched, such
+ * as the alpha of RGBA with a /p channels of 0x7.
+ *
+ * @param channels      Bit c set to blur component c
+ * @returns             true if successful
+ */
+bool gaussianBlurPlanar(const int width,
+                        const int height,
+                        const int minX,
+                        const int minY,
+                        const int maxX,
+                        const int maxY,
+                        const int components,
+                        const uint8_t *in,
+                        uint8_t *out,
+                        const int kernelSize,
+                        const double sigma,
+                        const BlurMode mode,
+                        const unsigned channels);
+
+
 /** Trim image
  *  ______________
  * |    ___       |        
@@ -104,6 +1117,35 @@ double computeKernel(double *out,
                      const double sigma);
 
 
+/** Compute 1d array of gaussian values
+ *
+ * The outer product of this array with itself equals computeKernel()
+ * once both are normalised.
+ *
+ * @param W           length of array
+ * @returns           sum of array, for use with normalise()
+ *
+ */
+double computeKernel1D(double *out,
+                       const int W,
+                       const double sigma);
+
+
+/** Compute linear array of an elliptical gaussian
+ *
+ * Rows of /p W values, with /p sigmaX along the axis at /p theta
+ * radians from the x axis, towards the y axis, and /p sigmaY across it.
+ * A reference for anisotropicBlur(), which does not build it.
+ *
+ * @returns           sum of array, for use with normalise()
+ */
+double computeKernelAnisotropic(double *out,
+                                const int W,
+                                const double sigmaX,
+                                const double sigmaY,
+                                const double theta);
+
+
 int computeIdentityKernel(double *out, const int W);
 
 
@@ -125,6 +1167,24 @@ void printKernel(const double *kernel, const int W);
 void computeRamp(double *out, const int W);
 
 
+/** Compute a quadrant of a falloff, between 0-1
+ *
+ * As laid out by cachedFalloff(); computeRamp() is the whole of
+ * FALLOFF_LINEAR over a square.
+ *
+ * @param out        (width / 2 + 2) * (height / 2 + 2) weights
+ * @param falloff    curve
+ * @param parameter  of curve, see setFalloff()
+ * @param width      of rectangle
+ * @param height     of curve; width unless FALLOFF_ELLIPTICAL
+ */
+void computeFalloff(double *out,
+                    const Falloff falloff,
+                    const double parameter,
+                    const int width,
+                    const int height);
+
+
 /** Interpolate between two linear matrices
  *
  * @param factor  value between 0-1, 0 means A and 1 means B
@@ -147,6 +1207,24 @@ int scale(const int factor,
           const int height,
           const int components);
 
+
+/** Scale up by /p factor, interpolating as the levels of pyramidBlur()
+ *
+ * Where scale() repeats each pixel, this doubles the image as many times
+ * as it takes, each time interpolating new pixels by the even and odd
+ * taps of the 5-tap binomial, such that there are no blocks.
+ *
+ * @param factor  a power of two
+ * @param out     width * factor by height * factor pixels
+ * @returns       0 for success, non-0 otherwise
+ */
+int scaleFiltered(const int factor,
+                  const uint8_t *in,
+                  uint8_t *out,
+                  const int width,
+                  const int height,
+                  const int components);
+
 /** Fit array between min/max
  *
  * @param  in      input array of pixels
@@ -1,17 +1,241 @@
 #define _XOPEN_SOURCE
 #define _XOPEN_SOURCE_EXTENDED
 
+#include <ctype.h>
 #include <limits.h>
+#include <math.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
 #include <stdio.h>
 
+#include "blur.h"
 #include "cli.h"
 #include "helpers.h"
 
 
+/* Append an area given as "x,y,size" to a growing array */
+static bool addArea(const char *text, Area **areas, int *areaCount)
+{
+  int x, y, size;
+  char rest;
+
+  if (sscanf(text, " %d , %d , %d %c", &x, &y, &size, &rest) != 3
+      || x < 0 || y < 0 || size < 1)
+  {
+    printf("Area (%s) must be given as x,y,size.\n", text);
+    return false;
+  }
+
+  Area *grown = (Area *) realloc(*areas, (*areaCount + 1) * sizeof(Area));
+
+  if (grown == NULL)
+  {
+    printf("Could not allocate enough memory.\n");
+    return false;
+  }
+
+  grown[*areaCount].minX = x;
+  grown[*areaCount].minY = y;
+  grown[*areaCount].maxX = x + size;
+  grown[*areaCount].maxY = y + size;
+
+  *areas = grown;
+  (*areaCount)++;
+
+  return true;
+}
+
+
+/* Append the areas of a file, one "x,y,size" per line */
+static bool readAreas(const char *filename, Area **areas, int *areaCount)
+{
+  FILE *file = fopen(filename, "r");
+
+  if (file == NULL)
+  {
+    printf("The file \"%s\" could not be opened.\n", filename);
+    return false;
+  }
+
+  char line[256];
+  bool ok = true;
+
+  while (ok && fgets(line, sizeof(line), file) != NULL)
+  {
+    const char *text = line;
+    while (isspace((unsigned char) *text))
+    {
+      text++;
+    }
+
+    /* Blank lines and comments */
+    if (*text != '\0' && *text != '#')
+    {
+      ok = addArea(text, areas, areaCount);
+    }
+  }
+
+  fclose(file);
+
+  return ok;
+}
+
+
+/* Append a disc given as "x,y,radius" to a growing array */
+static bool addDisc(const char *text, double **discs, int *discCount)
+{
+  double x, y, radius;
+  char rest;
+
+  if (sscanf(text, " %lf , %lf , %lf %c", &x, &y, &radius, &rest) != 3
+      || radius <= 0)
+  {
+    printf("Disc (%s) must be given as x,y,radius.\n", text);
+    return false;
+  }
+
+  double *grown = (double *) realloc(*discs, 3 * (*discCount + 1) * sizeof(double));
+
+  if (grown == NULL)
+  {
+    printf("Could not allocate enough memory.\n");
+    return false;
+  }
+
+  grown[3 * *discCount] = x;
+  grown[3 * *discCount + 1] = y;
+  grown[3 * *discCount + 2] = radius;
+
+  *discs = grown;
+  (*discCount)++;
+
+  return true;
+}
+
+
+/* Vertices of a polygon given as "x,y,x,y,..." */
+static bool readPolygon(const char *text, double **polygon, int *polygonCount)
+{
+  int values = 1;
+  for (const char *c = text; *c != '\0'; c++)
+  {
+    values += *c == ',';
+  }
+
+  double *points = (double *) malloc(values * sizeof(double));
+
+  if (points == NULL)
+  {
+    printf("Could not allocate enough memory.\n");
+    return false;
+  }
+
+  const char *next = text;
+  int count = 0;
+
+  while (count < values)
+  {
+    char *end;
+    points[count] = strtod(next, &end);
+
+    if (end == next || (*end != ',' && *end != '\0'))
+    {
+      break;
+    }
+
+    count++;
+    next = end + 1;
+  }
+
+  if (count != values || count % 2 != 0 || count < 6)
+  {
+    printf("Polygon (%s) must be given as x,y of 3 or more vertices.\n", text);
+    free(points);
+    return false;
+  }
+
+  free(*polygon);
+  *polygon = points;
+  *polygonCount = count / 2;
+
+  return true;
+}
+
+
+/* Ellipse given as "x,y,degrees"; lengths along its axes halved as for
+   the radius, and the angle of its first axis turned into radians */
+static bool parseEllipse(const char *text, double *ellipse)
+{
+  double x, y, degrees;
+  char rest;
+
+  if (sscanf(text, " %lf , %lf , %lf %c", &x, &y, &degrees, &rest) != 3
+      || x < 0 || y < 0)
+  {
+    printf("Ellipse (%s) must be given as x,y,degrees.\n", text);
+    return false;
+  }
+
+  ellipse[0] = x / 2;
+  ellipse[1] = y / 2;
+  ellipse[2] = degrees * M_PI / 180;
+
+  return true;
+}
+
+
+/* Curve of the falloff given as "name[,parameter]" */
+static bool parseFalloff(const char *text, Falloff *falloff, double *parameter)
+{
+  static const struct
+  {
+    const char *name;
+    Falloff falloff;
+    double parameter;           // if none is given
+  } curves[] = {
+    { "linear", FALLOFF_LINEAR, 1 },
+    { "smoothstep", FALLOFF_SMOOTHSTEP, 1 },
+    { "gamma", FALLOFF_GAMMA, 2.2 },
+    { "gaussian", FALLOFF_GAUSSIAN, 0.4 },
+    { "elliptical", FALLOFF_ELLIPTICAL, 1 }
+  };
+
+  const char *comma = strchr(text, ',');
+  size_t length = comma != NULL ? (size_t) (comma - text) : strlen(text);
+
+  char name[16] = "";
+  if (length < sizeof(name))
+  {
+    memcpy(name, text, length);
+    name[length] = '\0';
+  }
+
+  for (size_t i = 0; i < sizeof(curves) / sizeof(curves[0]); i++)
+  {
+    if (strcasecmp(name, curves[i].name) != 0)
+    {
+      continue;
+    }
+
+    *falloff = curves[i].falloff;
+    *parameter = comma != NULL ? atof(comma + 1) : curves[i].parameter;
+
+    if (!(*parameter > 0))
+    {
+      printf("Falloff parameter (%s) must be above 0.\n", comma + 1);
+      return false;
+    }
+
+    return true;
+  }
+
+  printf("Falloff (%s) must be one of linear, smoothstep, gamma, gaussian or elliptical.\n", text);
+  return false;
+}
+
+
 bool parseArgs(int argc,
                char **argv,
                char **filenameIn,
@@ -20,11 +244,30 @@ bool parseArgs(int argc,
                int *y,
                int *size,
                int *kernelSize,
-               double *radius)
+               double *radius,
+               BlurMode *mode,
+               int *threads,
+               BorderMode *border,
+               Falloff *falloff,
+               double *falloffParameter,
+               unsigned *channels,
+               char **filenameMask,
+               char **filenameMap,
+               int *passes,
+               bool *elliptical,
+               double *ellipse,
+               Area **areas,
+               int *areaCount,
+               double **discs,
+               int *discCount,
+               double **polygon,
+               int *polygonCount,
+               bool *inPlace,
+               bool *stream)
 {
 
   int c;
-  while ((c = getopt(argc, argv, "x:y:s:k:o:r:")) != -1)
+  while ((c = getopt(argc, argv, "x:y:s:k:o:r:E:e:t:b:c:p:m:v:n:a:f:d:g:iS")) != -1)
     switch (c)
     {
       case 'x':
@@ -67,6 +310,167 @@ bool parseArgs(int argc,
         /* Radius of effect */
         *radius = atof(optarg) / 2;
         break;
+      case 'E':
+        /* Elliptical kernel, long in one direction; replaces the radius */
+        if (!parseEllipse(optarg, ellipse))
+        {
+          return false;
+        }
+
+        *elliptical = true;
+        break;
+      case 'e':
+        /* Strategy by which to evaluate the kernel */
+        if (strcasecmp(optarg, "direct") == 0)
+        {
+          *mode = BLUR_DIRECT;
+        }
+        else if (strcasecmp(optarg, "separable") == 0)
+        {
+          *mode = BLUR_SEPARABLE;
+        }
+        else if (strcasecmp(optarg, "box") == 0)
+        {
+          *mode = BLUR_BOX;
+        }
+        else if (strcasecmp(optarg, "iir") == 0)
+        {
+          *mode = BLUR_IIR;
+        }
+        else if (strcasecmp(optarg, "fft") == 0)
+        {
+          *mode = BLUR_FFT;
+        }
+        else if (strcasecmp(optarg, "fixed") == 0)
+        {
+          *mode = BLUR_FIXED;
+        }
+        else if (strcasecmp(optarg, "interpolated") == 0)
+        {
+          *mode = BLUR_INTERPOLATED;
+        }
+        else if (strcasecmp(optarg, "pyramid") == 0)
+        {
+          *mode = BLUR_PYRAMID;
+        }
+        else if (strcasecmp(optarg, "auto") == 0)
+        {
+          *mode = BLUR_AUTO;
+        }
+        else
+        {
+          printf("Mode (%s) must be one of auto, direct, separable, box, iir, fft, fixed, interpolated or pyramid.\n", optarg);
+          return false;
+        }
+        break;
+      case 't':
+        /* Threads to run on; 0 means one per cpu (default) */
+        *threads = atoi(optarg);
+        if (*threads < 0)
+        {
+          printf("Threads must not be negative.\n");
+          return false;
+        }
+        break;
+      case 'b':
+        /* Samples beyond the edge of the image */
+        if (strcasecmp(optarg, "clamp") == 0)
+        {
+          *border = BORDER_CLAMP;
+        }
+        else if (strcasecmp(optarg, "mirror") == 0)
+        {
+          *border = BORDER_MIRROR;
+        }
+        else if (strcasecmp(optarg, "wrap") == 0)
+        {
+          *border = BORDER_WRAP;
+        }
+        else if (strcasecmp(optarg, "constant") == 0)
+        {
+          *border = BORDER_CONSTANT;
+        }
+        else
+        {
+          printf("Border (%s) must be one of clamp, mirror, wrap or constant.\n", optarg);
+          return false;
+        }
+        break;
+      case 'c':
+        /* Curve of the falloff, as name[,parameter]; e.g. gamma,2.2 */
+        if (!parseFalloff(optarg, falloff, falloffParameter))
+        {
+          return false;
+        }
+        break;
+      case 'p':
+        /* Blur these components only, each as a plane; e.g. 012 for RGB of RGBA */
+        *channels = 0;
+        for (const char *digit = optarg; *digit != '\0'; digit++)
+        {
+          if (!isdigit((unsigned char) *digit))
+          {
+            printf("Components (%s) must be given as digits, e.g. 012.\n", optarg);
+            return false;
+          }
+
+          *channels |= 1u << (*digit - '0');
+        }
+        break;
+      case 'a':
+        /* Area of effect as x,y,size; may be given many times */
+        if (!addArea(optarg, areas, areaCount))
+        {
+          return false;
+        }
+        break;
+      case 'f':
+        /* Areas of effect, one x,y,size per line */
+        if (!readAreas(optarg, areas, areaCount))
+        {
+          return false;
+        }
+        break;
+      case 'd':
+        /* Disc of effect as x,y,radius, in place of the rectangle; may be given many times */
+        if (!addDisc(optarg, discs, discCount))
+        {
+          return false;
+        }
+        break;
+      case 'g':
+        /* Polygon of effect as x,y of each vertex, in place of the rectangle */
+        if (!readPolygon(optarg, polygon, polygonCount))
+        {
+          return false;
+        }
+        break;
+      case 'i':
+        /* Blur the image in place, touching only the area */
+        *inPlace = true;
+        break;
+      case 'S':
+        /* Stream rows from a .ppm or .pgm, holding only what the kernel reaches */
+        *stream = true;
+        break;
+      case 'm':
+        /* Weight of the blur per pixel, in place of the rectangle */
+        *filenameMask = optarg;
+        break;
+      case 'v':
+        /* Radius per pixel, scaled by a depth map up to that of -r */
+        *filenameMap = optarg;
+        break;
+      case 'n':
+        /* Boxes cascaded by the variable blur, closer to a gaussian as more */
+        *passes = atoi(optarg);
+
+        if (*passes < 1 || *passes > 5)
+        {
+          printf("Passes (%s) must be from 1 to 5.\n", optarg);
+          return false;
+        }
+        break;
       case 'o':
         *filenameOut = optarg;
 
@@ -77,7 +481,7 @@ bool parseArgs(int argc,
 
   if (argc - optind != 1)
   {
-    printf("Usage: ./blur [-o] [-x] [-y] [-s] [-k] [-i] input\n");
+    printf("Usage: ./blur [-o] [-x] [-y] [-s] [-k] [-r] [-E] [-e] [-t] [-b] [-c] [-p] [-m] [-v] [-n] [-a] [-f] [-d] [-g] [-i] [-S] input\n");
     return false;
   }
 
@@ -125,9 +529,15 @@ bool parseArgs(int argc,
 
   *filenameOut = filenameOutDyn;
 
-  if (strcmp(strrchr(*filenameIn, '.'), ".png") != 0)
+  const char *extension = strrchr(*filenameIn, '.');
+
+  if (extension == NULL
+      || (strcasecmp(extension, ".png") != 0
+          && strcasecmp(extension, ".hdr") != 0
+          && strcasecmp(extension, ".ppm") != 0
+          && strcasecmp(extension, ".pgm") != 0))
   {
-      printf("Input must be end with .png\n");
+      printf("Input must be end with .png, .hdr, .ppm or .pgm\n");
       printf("Got \"%s\"\n", *filenameIn);
       return false;
   }
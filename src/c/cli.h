@@ -10,4 +10,23 @@ bool parseArgs(int argc,
                int *y,
                int *size,
                int *kernelSize,
-               double *radius);
+               double *radius,
+               BlurMode *mode,
+               int *threads,
+               BorderMode *border,
+               Falloff *falloff,
+               double *falloffParameter,
+               unsigned *channels,
+               char **filenameMask,
+               char **filenameMap,
+               int *passes,
+               bool *elliptical,
+               double *ellipse,
+               Area **areas,
+               int *areaCount,
+               double **discs,
+               int *discCount,
+               double **polygon,
+               int *polygonCount,
+               bool *inPlace,
+               bool *stream);
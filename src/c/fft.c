@@ -0,0 +1,302 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <math.h>
+
+#include "fft.h"
+
+#define M_PI 3.14159265358979323846
+
+
+int fftSize(const int n)
+{
+  int size = 2;
+  while (size < n)
+  {
+    size *= 2;
+  }
+
+  return size;
+}
+
+
+/* Table of n / 2 + 1 complex twiddle factors, exp(-2 pi i k / n) */
+static double *computeTwiddles(const int n)
+{
+  double *twiddles = (double *) malloc((n / 2 + 1) * 2 * sizeof(double));
+
+  if (twiddles == NULL)
+  {
+    return NULL;
+  }
+
+  for (int k = 0; k <= n / 2; k++)
+  {
+    twiddles[2 * k] = cos(-2 * M_PI * k / n);
+    twiddles[2 * k + 1] = sin(-2 * M_PI * k / n);
+  }
+
+  return twiddles;
+}
+
+
+/* Complex transform of /p n values
+
+The twiddles of a transform of size n are every /p stride'th entry of a
+table computed for n * stride, such that one table serves both a real
+transform and the complex transform of half its size.
+
+*/
+static void transform(double *data,
+                      const int n,
+                      const double *twiddles,
+                      const int stride,
+                      const bool inverse)
+{
+  /* Bit-reversal permutation */
+  for (int i = 1, j = 0; i < n; i++)
+  {
+    int bit = n >> 1;
+    for (; j & bit; bit >>= 1)
+    {
+      j ^= bit;
+    }
+    j ^= bit;
+
+    if (i < j)
+    {
+      double re = data[2 * i], im = data[2 * i + 1];
+      data[2 * i] = data[2 * j];
+      data[2 * i + 1] = data[2 * j + 1];
+      data[2 * j] = re;
+      data[2 * j + 1] = im;
+    }
+  }
+
+  /* Butterflies, doubling in length each stage */
+  double sign = inverse ? -1 : 1;
+  for (int length = 2; length <= n; length *= 2)
+  {
+    int half = length / 2;
+    int step = (n / length) * stride;
+
+    for (int i = 0; i < n; i += length)
+    {
+      for (int j = 0; j < half; j++)
+      {
+        double wr = twiddles[2 * j * step];
+        double wi = twiddles[2 * j * step + 1] * sign;
+
+        double *a = data + 2 * (i + j);
+        double *b = data + 2 * (i + j + half);
+
+        double tr = b[0] * wr - b[1] * wi;
+        double ti = b[0] * wi + b[1] * wr;
+
+        b[0] = a[0] - tr;
+        b[1] = a[1] - ti;
+        a[0] += tr;
+        a[1] += ti;
+      }
+    }
+  }
+}
+
+
+void fft(double *data, const int n, const bool inverse)
+{
+  double *twiddles = computeTwiddles(n);
+
+  if (twiddles == NULL)
+  {
+    return;
+  }
+
+  transform(data, n, twiddles, 1, inverse);
+  free(twiddles);
+}
+
+
+/* Real transform of /p n values, by way of a complex transform of n / 2
+
+Even and odd samples are packed as real and imaginary parts, transformed
+together and then separated by symmetry.
+
+Reference:
+ - http://www.robinscheibler.org/2013/02/13/real-fft.html
+
+*/
+static void realForward(const double *in,
+                        double *out,
+                        const int n,
+                        const double *twiddles,
+                        double *scratch)
+{
+  int half = n / 2;
+
+  for (int i = 0; i < n; i++)
+  {
+    scratch[i] = in[i];
+  }
+
+  transform(scratch, half, twiddles, 2, false);
+
+  for (int k = 0; k <= half; k++)
+  {
+    int a = k % half;
+    int b = (half - k) % half;
+
+    /* Z[k] and conj(Z[n / 2 - k]) */
+    double ar = scratch[2 * a], ai = scratch[2 * a + 1];
+    double br = scratch[2 * b], bi = -scratch[2 * b + 1];
+
+    /* Spectra of even and odd samples */
+    double er = (ar + br) / 2, ei = (ai + bi) / 2;
+    double odr = (ai - bi) / 2, odi = -(ar - br) / 2;
+
+    double wr = twiddles[2 * k], wi = twiddles[2 * k + 1];
+
+    out[2 * k] = er + odr * wr - odi * wi;
+    out[2 * k + 1] = ei + odr * wi + odi * wr;
+  }
+}
+
+
+/* Inverse of realForward(), scaled by n / 2 */
+static void realInverse(const double *in,
+                        double *out,
+                        const int n,
+                        const double *twiddles)
+{
+  int half = n / 2;
+
+  for (int k = 0; k < half; k++)
+  {
+    /* X[k] and conj(X[n / 2 - k]) */
+    double ar = in[2 * k], ai = in[2 * k + 1];
+    double br = in[2 * (half - k)], bi = -in[2 * (half - k) + 1];
+
+    double er = (ar + br) / 2, ei = (ai + bi) / 2;
+    double dr = (ar - br) / 2, di = (ai - bi) / 2;
+
+    /* Undo the twiddle, exp(+2 pi i k / n) */
+    double wr = twiddles[2 * k], wi = -twiddles[2 * k + 1];
+    double odr = dr * wr - di * wi;
+    double odi = dr * wi + di * wr;
+
+    /* Z = E + iO */
+    out[2 * k] = er - odi;
+    out[2 * k + 1] = ei + odr;
+  }
+
+  transform(out, half, twiddles, 2, true);
+}
+
+
+void fftReal2D(const double *in,
+               double *out,
+               const int width,
+               const int height)
+{
+  int columns = width / 2 + 1;
+
+  double *rowTwiddles = computeTwiddles(width);
+  double *columnTwiddles = computeTwiddles(height);
+  double *scratch = (double *) malloc(
+    (width > 2 * height ? width : 2 * height) * sizeof(double));
+
+  if (rowTwiddles == NULL || columnTwiddles == NULL || scratch == NULL)
+  {
+    free(rowTwiddles);
+    free(columnTwiddles);
+    free(scratch);
+    return;
+  }
+
+  for (int row = 0; row < height; row++)
+  {
+    realForward(in + row * width,
+                out + row * columns * 2,
+                width,
+                rowTwiddles,
+                scratch);
+  }
+
+  /* Columns are gathered into contiguous memory before transforming */
+  for (int col = 0; col < columns; col++)
+  {
+    for (int row = 0; row < height; row++)
+    {
+      scratch[2 * row] = out[(row * columns + col) * 2];
+      scratch[2 * row + 1] = out[(row * columns + col) * 2 + 1];
+    }
+
+    transform(scratch, height, columnTwiddles, 1, false);
+
+    for (int row = 0; row < height; row++)
+    {
+      out[(row * columns + col) * 2] = scratch[2 * row];
+      out[(row * columns + col) * 2 + 1] = scratch[2 * row + 1];
+    }
+  }
+
+  free(rowTwiddles);
+  free(columnTwiddles);
+  free(scratch);
+}
+
+
+void fftRealInverse2D(double *in,
+                      double *out,
+                      const int width,
+                      const int height)
+{
+  int columns = width / 2 + 1;
+
+  double *rowTwiddles = computeTwiddles(width);
+  double *columnTwiddles = computeTwiddles(height);
+  double *scratch = (double *) malloc(
+    (width > 2 * height ? width : 2 * height) * sizeof(double));
+
+  if (rowTwiddles == NULL || columnTwiddles == NULL || scratch == NULL)
+  {
+    free(rowTwiddles);
+    free(columnTwiddles);
+    free(scratch);
+    return;
+  }
+
+  for (int col = 0; col < columns; col++)
+  {
+    for (int row = 0; row < height; row++)
+    {
+      scratch[2 * row] = in[(row * columns + col) * 2];
+      scratch[2 * row + 1] = in[(row * columns + col) * 2 + 1];
+    }
+
+    transform(scratch, height, columnTwiddles, 1, true);
+
+    for (int row = 0; row < height; row++)
+    {
+      in[(row * columns + col) * 2] = scratch[2 * row];
+      in[(row * columns + col) * 2 + 1] = scratch[2 * row + 1];
+    }
+  }
+
+  double scale = 2.0 / ((double) width * height);
+
+  for (int row = 0; row < height; row++)
+  {
+    double *target = out + row * width;
+
+    realInverse(in + row * columns * 2, target, width, rowTwiddles);
+
+    for (int i = 0; i < width; i++)
+    {
+      target[i] *= scale;
+    }
+  }
+
+  free(rowTwiddles);
+  free(columnTwiddles);
+  free(scratch);
+}
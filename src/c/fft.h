@@ -0,0 +1,55 @@
+#include <stdbool.h>
+
+
+/** Smallest power of two greater than or equal to /p n, and at least 2
+ */
+int fftSize(const int n);
+
+
+/** Complex fast fourier transform, in-place
+ *
+ * Radix-2 decimation in time over /p n complex values stored as
+ * interleaved (real, imaginary) pairs. The inverse is unscaled; divide
+ * by /p n to get the original values back.
+ *
+ * @param data     2 * n doubles
+ * @param n        number of complex values, a power of two
+ * @param inverse  whether to run the inverse transform
+ *
+ * Reference:
+ *  - https://en.wikipedia.org/wiki/Cooley%E2%80%93Tukey_FFT_algorithm
+ */
+void fft(double *data, const int n, const bool inverse);
+
+
+/** Real to complex fourier transform of a 2d array
+ *
+ *    width          width / 2 + 1
+ *  _________         _____
+ * |         |       |     |
+ * |  real   | ----> | c   |  height
+ * |_________|       |_____|
+ *
+ * Only the non-redundant half of the spectrum is produced, as the rest
+ * is its complex conjugate.
+ *
+ * @param in      height scanlines of width reals
+ * @param out     height scanlines of width / 2 + 1 interleaved complex values
+ * @param width   a power of two
+ * @param height  a power of two
+ */
+void fftReal2D(const double *in,
+               double *out,
+               const int width,
+               const int height);
+
+
+/** Inverse of fftReal2D()
+ *
+ * Scaled, such that the original values are returned. The contents
+ * of /p in are destroyed.
+ */
+void fftRealInverse2D(double *in,
+                      double *out,
+                      const int width,
+                      const int height);
@@ -0,0 +1,309 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifndef _MSC_VER
+#include <pthread.h>
+#define CACHE_PTHREADS 1
+#endif
+
+#include "blur.h"
+#include "simd.h"
+
+/* Falloff tables kept at most, such that a rectangle of changing size
+   does not grow the cache without bound */
+#define FALLOFF_TABLES 32
+
+/* Weights of the largest falloff table kept; a quadrant of 4096 pixels
+   square, or 32 MB */
+#define FALLOFF_TABLE_LIMIT (2049 * 2049)
+
+
+/* Kernel of the cache; immutable once linked in, such that callers keep
+   reading its values after the lock is released */
+typedef struct Entry
+{
+  struct Entry *next;
+  int kernelSize;
+  double sigma;
+  KernelType type;
+  double values[];              // or int16_t, as of type
+} Entry;
+
+
+/* Falloff table of the cache; as immutable as a kernel */
+typedef struct Table
+{
+  struct Table *next;
+  Falloff falloff;
+  double parameter;
+  int width;
+  int height;
+  double values[];
+} Table;
+
+
+static Entry *entries = NULL;
+static Table *tables = NULL;
+static int tableCount = 0;
+
+#ifdef CACHE_PTHREADS
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+#define LOCK() pthread_mutex_lock(&lock)
+#define UNLOCK() pthread_mutex_unlock(&lock)
+#else
+#define LOCK()
+#define UNLOCK()
+#endif
+
+
+static Entry *find(Entry *first,
+                   const int kernelSize,
+                   const double sigma,
+                   const KernelType type)
+{
+  for (Entry *entry = first; entry != NULL; entry = entry->next)
+  {
+    if (entry->kernelSize == kernelSize
+        && entry->type == type
+        && (type == KERNEL_IDENTITY || entry->sigma == sigma))
+    {
+      return entry;
+    }
+  }
+
+  return NULL;
+}
+
+
+/* Compute a kernel outside of the lock; fixed-point variants are
+   quantised from their cached floating-point counterparts */
+static Entry *compute(const int kernelSize,
+                      const double sigma,
+                      const KernelType type)
+{
+  bool square = type == KERNEL_2D
+    || type == KERNEL_FIXED_2D
+    || type == KERNEL_IDENTITY;
+  bool fixed = type == KERNEL_FIXED_1D || type == KERNEL_FIXED_2D;
+  int taps = square ? kernelSize * kernelSize : kernelSize;
+
+  const double *source = NULL;
+  if (fixed)
+  {
+    source = (const double *) cachedKernel(kernelSize, sigma,
+                                           square ? KERNEL_2D : KERNEL_1D);
+    if (source == NULL)
+    {
+      return NULL;
+    }
+  }
+
+  size_t size = taps * (fixed ? sizeof(int16_t) : sizeof(double));
+  Entry *entry = (Entry *) malloc(sizeof(Entry) + size);
+
+  if (entry == NULL)
+  {
+    return NULL;
+  }
+
+  entry->next = NULL;
+  entry->kernelSize = kernelSize;
+  entry->sigma = sigma;
+  entry->type = type;
+
+  if (type == KERNEL_1D)
+  {
+    double sum = computeKernel1D(entry->values, kernelSize, sigma);
+    normalise(entry->values, sum, kernelSize, 1);
+  }
+  else if (type == KERNEL_2D)
+  {
+    double sum = computeKernel(entry->values, kernelSize, sigma);
+    normalise(entry->values, sum, kernelSize, kernelSize);
+  }
+  else if (type == KERNEL_IDENTITY)
+  {
+    computeIdentityKernel(entry->values, kernelSize);
+  }
+  else if (quantiseKernel(source, (int16_t *) entry->values,
+                          taps, FIXED_SHIFT) != 0)
+  {
+    free(entry);
+    return NULL;
+  }
+
+  return entry;
+}
+
+
+const void *cachedKernel(const int kernelSize,
+                         const double sigma,
+                         const KernelType type)
+{
+  if (kernelSize < 1 || kernelSize % 2 != 1)
+  {
+    return NULL;
+  }
+
+  LOCK();
+  Entry *entry = find(entries, kernelSize, sigma, type);
+  UNLOCK();
+
+  if (entry != NULL)
+  {
+    return entry->values;
+  }
+
+  /* Computed without the lock, so that a large kernel does not hold up
+     others; should another thread get there first, its kernel wins */
+  Entry *computed = compute(kernelSize, sigma, type);
+
+  if (computed == NULL)
+  {
+    return NULL;
+  }
+
+  LOCK();
+  entry = find(entries, kernelSize, sigma, type);
+  if (entry == NULL)
+  {
+    computed->next = entries;
+    entries = computed;
+    entry = computed;
+    computed = NULL;
+  }
+  UNLOCK();
+
+  free(computed);
+
+  return entry->values;
+}
+
+
+bool preloadKernel(const int kernelSize, const double sigma)
+{
+  bool ok = true;
+
+  for (int type = KERNEL_1D; type <= KERNEL_IDENTITY; type++)
+  {
+    ok = cachedKernel(kernelSize, sigma, (KernelType) type) != NULL && ok;
+  }
+
+  return ok;
+}
+
+
+static Table *findTable(Table *first,
+                        const Falloff falloff,
+                        const double parameter,
+                        const int width,
+                        const int height)
+{
+  bool parametric = falloff == FALLOFF_GAMMA || falloff == FALLOFF_GAUSSIAN;
+
+  for (Table *table = first; table != NULL; table = table->next)
+  {
+    if (table->falloff == falloff
+        && table->width == width
+        && table->height == height
+        && (!parametric || table->parameter == parameter))
+    {
+      return table;
+    }
+  }
+
+  return NULL;
+}
+
+
+const double *cachedFalloff(const Falloff falloff,
+                            const double parameter,
+                            const int width,
+                            const int height)
+{
+  if (width < 0 || height < 0)
+  {
+    return NULL;
+  }
+
+  size_t size = (size_t) (width / 2 + 2) * (height / 2 + 2);
+
+  if (size > FALLOFF_TABLE_LIMIT)
+  {
+    return NULL;
+  }
+
+  LOCK();
+  Table *table = findTable(tables, falloff, parameter, width, height);
+  bool full = tableCount >= FALLOFF_TABLES;
+  UNLOCK();
+
+  if (table != NULL)
+  {
+    return table->values;
+  }
+
+  if (full)
+  {
+    return NULL;
+  }
+
+  Table *computed = (Table *) malloc(sizeof(Table) + size * sizeof(double));
+
+  if (computed == NULL)
+  {
+    return NULL;
+  }
+
+  computed->next = NULL;
+  computed->falloff = falloff;
+  computed->parameter = parameter;
+  computed->width = width;
+  computed->height = height;
+  computeFalloff(computed->values, falloff, parameter, width, height);
+
+  LOCK();
+  table = findTable(tables, falloff, parameter, width, height);
+  if (table == NULL && tableCount < FALLOFF_TABLES)
+  {
+    computed->next = tables;
+    tables = computed;
+    tableCount++;
+    table = computed;
+    computed = NULL;
+  }
+  UNLOCK();
+
+  free(computed);
+
+  return table != NULL ? table->values : NULL;
+}
+
+
+void clearKernelCache(void)
+{
+  LOCK();
+  Entry *entry = entries;
+  Table *table = tables;
+  entries = NULL;
+  tables = NULL;
+  tableCount = 0;
+  UNLOCK();
+
+  while (entry != NULL)
+  {
+    Entry *next = entry->next;
+    free(entry);
+    entry = next;
+  }
+
+  while (table != NULL)
+  {
+    Table *next = table->next;
+    free(table);
+    table = next;
+  }
+}
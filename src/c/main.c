@@ -15,6 +15,74 @@
 #include "blur.h"
 #include "cli.h"
 #include "helpers.h"
+#include "pnm.h"
+#include "png.h"
+
+
+/* Whether filename ends in extension, ignoring case */
+static bool hasExtension(const char *filename, const char *extension)
+{
+    const char *dot = strrchr(filename, '.');
+    return dot != NULL && strcasecmp(dot, extension) == 0;
+}
+
+
+/* Blur a netpbm image a row at a time into a PNG or netpbm image, with
+   never more than the reach of the kernel in memory */
+static bool streamImage(const char *filenameIn,
+                        const char *filenameOut,
+                        const int x,
+                        const int y,
+                        const int size,
+                        const int kernelSize,
+                        const double radius)
+{
+    PNMFile in;
+    if (!openPNM(&in, filenameIn))
+    {
+        printf("Could not open \"%s\" as a binary .ppm or .pgm.\n", filenameIn);
+        return false;
+    }
+
+    PNGFile png;
+    PNMFile pnm;
+    bool isPNG = hasExtension(filenameOut, ".png");
+    bool created = isPNG
+        ? createPNG(&png, filenameOut, in.width, in.height, in.components, in.type)
+        : (hasExtension(filenameOut, ".ppm") || hasExtension(filenameOut, ".pgm"))
+          && createPNM(&pnm, filenameOut, in.width, in.height, in.components, in.type);
+
+    if (!created)
+    {
+        printf("Could not create \"%s\" as a .png, .ppm or .pgm.\n", filenameOut);
+        closePNM(&in);
+        return false;
+    }
+
+    bool ok = gaussianBlurStream(in.width, in.height, x, y, x + size, y + size,
+                                 in.components, in.type,
+                                 readPNMRow, &in,
+                                 isPNG ? writePNGRow : writePNMRow,
+                                 isPNG ? (void *) &png : (void *) &pnm,
+                                 kernelSize, radius);
+
+    ok = (isPNG ? closePNG(&png) : closePNM(&pnm)) && ok;
+    closePNM(&in);
+
+    /* Rows are written as they are done; leave no partial image behind */
+    if (!ok)
+    {
+        printf("Could not stream \"%s\" to \"%s\".\n", filenameIn, filenameOut);
+        remove(filenameOut);
+        return false;
+    }
+
+    printf("Wrote: %s (%ix%ix%i) (x=%i, y=%i, size=%i) to %s\n",
+           filenameIn, in.width, in.height, in.components, x, y, size,
+           filenameOut);
+
+    return true;
+}
 
 
 int main(int argc, char **argv)
@@ -22,73 +90,431 @@ int main(int argc, char **argv)
     /* Command-line argument default values */
     char *filenameIn = NULL;
     char *filenameOut = NULL;
+    char *filenameMask = NULL;
+    char *filenameMap = NULL;
+    int passes = 3;
+    bool elliptical = false;
+    double ellipse[3] = { 0 };
+    Area *areas = NULL;
+    int areaCount = 0;
+    double *discs = NULL;
+    int discCount = 0;
+    double *polygon = NULL;
+    int polygonCount = 0;
     double radius = 1;
+    BlurMode mode = BLUR_AUTO;
+    BorderMode border = BORDER_CLAMP;
+    Falloff falloff = FALLOFF_LINEAR;
+    double falloffParameter = 1;
+    bool inPlace = false;
+    bool stream = false;
+    unsigned channels = 0;
     int x = 0,
         y = 0,
         size = 80,
-        kernelSize = 5;
+        kernelSize = 5,
+        threads = 0;
 
     if (!parseArgs(argc, argv, &filenameIn, &filenameOut,
-                   &x, &y, &size, &kernelSize, &radius))
+                   &x, &y, &size, &kernelSize, &radius, &mode, &threads, &border,
+                   &falloff, &falloffParameter, &channels,
+                   &filenameMask, &filenameMap, &passes, &elliptical, ellipse,
+                   &areas, &areaCount, &discs, &discCount,
+                   &polygon, &polygonCount, &inPlace, &stream))
     {
         return 1;
     }
 
-    if (size < kernelSize)
+    detectInstructionSet();
+    setBorder(border, 0);
+    setFalloff(falloff, falloffParameter);
+
+    if (!setThreadCount(threads))
+    {
+        printf("Could not start %i threads.\n", threads);
+        return 1;
+    }
+
+    bool shaped = discCount > 0 || polygonCount > 0;
+
+    if (size < kernelSize && filenameMask == NULL && filenameMap == NULL && !shaped)
     {
         printf("Size too small.\n");
         return 1;
     }
 
-    /* Load an image into memory, and set aside memory for result */
+    if (stream)
+    {
+        if (inPlace || channels != 0 || areaCount > 0 || filenameMask != NULL
+            || filenameMap != NULL || elliptical || shaped)
+        {
+            printf("Streaming (-S) applies to a single area of all components.\n");
+            return 1;
+        }
+
+        bool ok = streamImage(filenameIn, filenameOut, x, y, size,
+                              kernelSize, radius);
+
+        free(areas);
+        free(discs);
+        free(polygon);
+        free(filenameIn);
+        free(filenameOut);
+
+        return ok ? 0 : 1;
+    }
+
+    if (areaCount > 0 && (filenameMask != NULL || shaped))
+    {
+        printf("Areas (-a, -f) cannot be combined with a mask (-m) or shapes (-d, -g).\n");
+        return 1;
+    }
+
+    if (filenameMap != NULL
+        && (inPlace || channels != 0 || areaCount > 0 || filenameMask != NULL || shaped))
+    {
+        printf("A depth map (-v) applies to a single area of all components.\n");
+        return 1;
+    }
+
+    if (elliptical
+        && (inPlace || channels != 0 || areaCount > 0 || filenameMap != NULL))
+    {
+        printf("An ellipse (-E) applies to a single area of all components.\n");
+        return 1;
+    }
+
+    /* Load an image into memory at its own depth, and set aside memory
+       for result; HDR is blurred as float, 16-bit netpbm as uint16_t */
     int width, height, comp;
-    uint8_t *pixelsIn = stbi_load(filenameIn, &width, &height, &comp, 0);
-    uint8_t *pixelsOut = (uint8_t *) malloc(
-        height * width * comp * sizeof(uint8_t *));
+    PixelType type = PIXEL_U8;
+    void *pixelsIn;
+
+    if (stbi_is_hdr(filenameIn))
+    {
+        pixelsIn = stbi_loadf(filenameIn, &width, &height, &comp, 0);
+        type = PIXEL_F32;
+    }
+    else if (hasExtension(filenameIn, ".ppm") || hasExtension(filenameIn, ".pgm"))
+    {
+        pixelsIn = loadPNM(filenameIn, &width, &height, &comp, &type);
+    }
+    else
+    {
+        pixelsIn = stbi_load(filenameIn, &width, &height, &comp, 0);
+    }
 
     if (pixelsIn == NULL)
     {
         printf("Could not load \"%s\".\n", filenameIn);
+        return 1;
+    }
+
+    /* Set aside memory for result, unless blurring in place; engines
+       copy what they leave untouched themselves */
+    void *pixelsOut = NULL;
+
+    if (!inPlace)
+    {
+        pixelsOut = malloc((size_t) height * width * comp * pixelTypeSize(type));
+
+        if (pixelsOut == NULL)
+        {
+            printf("Could not allocate enough memory.\n");
+            free(pixelsIn);
+            return 1;
+        }
+    }
+
+    /* Clamp x and y to available space */
+    x = x > width ? width : x;
+    y = y > height ? height : y;
+
+    int maxX = x + size,
+        maxY = y + size;
+
+    /* A mask replaces the rectangle, which then only serves to skip
+       the parts of the image the mask leaves alone */
+    uint8_t *mask = NULL;
+
+    if (filenameMask != NULL)
+    {
+        int maskWidth, maskHeight, maskComp;
+        mask = stbi_load(filenameMask, &maskWidth, &maskHeight, &maskComp, 1);
+
+        if (mask == NULL || maskWidth != width || maskHeight != height)
+        {
+            printf("Could not load \"%s\" as a %ix%i mask.\n",
+                   filenameMask, width, height);
+            stbi_image_free(mask);
+            free(pixelsIn);
+            free(pixelsOut);
+            return 1;
+        }
+
+        if (!maskBounds(mask, width, height, &x, &y, &maxX, &maxY))
+        {
+            x = y = width + height;   // nothing to blur
+        }
+
+        setMask(mask);
+    }
+
+    /* A depth map replaces the rectangle as well, scaling the radius of
+       each pixel from none at 0 to that of -r at 255 */
+    uint8_t *map = NULL;
+
+    if (filenameMap != NULL)
+    {
+        int mapWidth, mapHeight, mapComp;
+        map = stbi_load(filenameMap, &mapWidth, &mapHeight, &mapComp, 1);
+
+        if (map == NULL || mapWidth != width || mapHeight != height)
+        {
+            printf("Could not load \"%s\" as a %ix%i depth map.\n",
+                   filenameMap, width, height);
+            stbi_image_free(map);
+            free(pixelsIn);
+            free(pixelsOut);
+            return 1;
+        }
+
+        if (!maskBounds(map, width, height, &x, &y, &maxX, &maxY))
+        {
+            x = y = width + height;   // nothing to blur
+        }
+    }
+
+    /* Discs and a polygon replace the rectangle likewise, by a shape of
+       which only the runs are blurred */
+    Shape *shape = NULL;
+
+    if (shaped)
+    {
+        Shape *disc = discCount > 0
+            ? shapeFromCircles(discs, discCount, width, height)
+            : NULL;
+        Shape *outline = polygonCount > 0
+            ? shapeFromPolygon(polygon, polygonCount, width, height)
+            : NULL;
+
+        bool built = (discCount == 0 || disc != NULL)
+            && (polygonCount == 0 || outline != NULL);
+
+        shape = !built ? NULL
+            : disc != NULL && outline != NULL ? shapeUnion(disc, outline)
+            : disc != NULL ? disc : outline;
+
+        if (shape != disc)
+        {
+            freeShape(disc);
+        }
+
+        if (shape != outline)
+        {
+            freeShape(outline);
+        }
+
+        if (shape == NULL)
+        {
+            printf("Could not allocate enough memory.\n");
+            stbi_image_free(mask);
+            stbi_image_free(map);
+            free(pixelsIn);
+            free(pixelsOut);
+            return 1;
+        }
+
+        if (!shapeBounds(shape, &x, &y, &maxX, &maxY))
+        {
+            x = y = width + height;   // nothing to blur
+        }
+
+        setShape(shape);
+    }
+
+    if (inPlace && (channels != 0 || areaCount > 0))
+    {
+        printf("In place (-i) applies to a single area of all components.\n");
+        stbi_image_free(mask);
+        stbi_image_free(map);
+        freeShape(shape);
+        free(pixelsIn);
+        return 1;
+    }
+
+    if (channels != 0 && areaCount > 0)
+    {
+        printf("Components (-p) apply to a single area only.\n");
+        stbi_image_free(mask);
+        stbi_image_free(map);
+        freeShape(shape);
+        free(pixelsIn);
         free(pixelsOut);
         return 1;
     }
 
-    if (pixelsOut == NULL)
+    if (channels != 0 && type != PIXEL_U8)
     {
-        printf("Could not allocate enough memory.\n");
+        printf("Components (-p) require an 8-bit image.\n");
+        stbi_image_free(mask);
+        stbi_image_free(map);
+        freeShape(shape);
         free(pixelsIn);
+        free(pixelsOut);
         return 1;
     }
 
-    memcpy(pixelsOut, pixelsIn, height * width * comp * sizeof(uint8_t));
+    if (inPlace)
+    {
+        /* Only the rectangle and its halo are touched */
+        if (!gaussianBlurInPlace(width, height, x, y, maxX, maxY, comp, type,
+                                 pixelsIn, kernelSize, radius))
+        {
+            printf("Could not blur \"%s\" in place.\n", filenameIn);
+            stbi_image_free(mask);
+            stbi_image_free(map);
+            freeShape(shape);
+            free(pixelsIn);
+            return 1;
+        }
+    }
+    else if (channels != 0)
+    {
+        if (!gaussianBlurPlanar(width, height, x, y, maxX, maxY, comp,
+                                pixelsIn, pixelsOut, kernelSize, radius, mode,
+                                channels))
+        {
+            printf("Could not blur \"%s\" in this mode.\n", filenameIn);
+            stbi_image_free(mask);
+            stbi_image_free(map);
+            freeShape(shape);
+            free(pixelsIn);
+            free(pixelsOut);
+            return 1;
+        }
+    }
+    else if (map != NULL)
+    {
+        /* Boxes from a summed-area table, of any radius at the same cost */
+        if (!variableBlur(width, height, x, y, maxX, maxY, comp, type,
+                          pixelsIn, pixelsOut, map, radius, passes))
+        {
+            printf("Could not blur \"%s\" by depth.\n", filenameIn);
+            stbi_image_free(mask);
+            stbi_image_free(map);
+            freeShape(shape);
+            free(pixelsIn);
+            free(pixelsOut);
+            return 1;
+        }
+    }
+    else if (elliptical)
+    {
+        /* Two passes, along rows or columns and along a sheared line */
+        if (!anisotropicBlur(width, height, x, y, maxX, maxY, comp, type,
+                             pixelsIn, pixelsOut,
+                             ellipse[0], ellipse[1], ellipse[2]))
+        {
+            printf("Could not blur \"%s\" by an ellipse.\n", filenameIn);
+            stbi_image_free(mask);
+            stbi_image_free(map);
+            freeShape(shape);
+            free(pixelsIn);
+            free(pixelsOut);
+            return 1;
+        }
+    }
+    else if (areaCount > 0)
+    {
+        /* Every area in a single pass over the image */
+        if (!gaussianBlurAreas(width, height, areas, areaCount, comp, type,
+                               pixelsIn, pixelsOut, kernelSize, radius, mode))
+        {
+            printf("Could not blur \"%s\" in this mode.\n", filenameIn);
+            stbi_image_free(mask);
+            stbi_image_free(map);
+            freeShape(shape);
+            free(pixelsIn);
+            free(pixelsOut);
+            return 1;
+        }
+    }
+    else if (!gaussianBlurTyped(width,
+                                height,
+                                x,          // Define box
+                                y,          //
+                                maxX,       //
+                                maxY,       //
+                                comp,       // components
+                                type,       // of in and out
+                                pixelsIn,   // in
+                                pixelsOut,  // out
+                                kernelSize, // kernelSize
+                                radius,     // sigma
+                                mode        // mode
+             ))
+    {
+        printf("Could not blur \"%s\" in this mode.\n", filenameIn);
+        stbi_image_free(mask);
+        stbi_image_free(map);
+        freeShape(shape);
+        free(pixelsIn);
+        free(pixelsOut);
+        return 1;
+    }
 
-    /* Clamp x and y to available space */
-    x = x > width ? width : x;
-    y = y > height ? height : y;
+    /* Write at the depth of the output format, converting if need be */
+    PixelType typeOut = PIXEL_U8;
+
+    if (hasExtension(filenameOut, ".hdr"))
+    {
+        typeOut = PIXEL_F32;
+    }
+    else if ((hasExtension(filenameOut, ".ppm") || hasExtension(filenameOut, ".pgm"))
+             && type != PIXEL_U8)
+    {
+        typeOut = PIXEL_U16;
+    }
+
+    void *pixelsResult = inPlace ? pixelsIn : pixelsOut;
+    void *pixelsWrite = pixelsResult;
 
-    double *kernel = (double *) malloc(kernelSize * kernelSize * sizeof(double));
-    double sum = computeKernel(kernel,
-                  kernelSize,
-                  radius  // sigma
-    );
-
-    normalise(kernel, sum, kernelSize, kernelSize);
-
-    convolve(width,
-             height,
-             x,          // Define box
-             y,          //
-             x + size,   //
-             y + size,   //
-             comp,       // components
-             pixelsIn,   // in
-             pixelsOut,  // out
-             kernel,     // kernel
-             kernelSize  // kernelSize
-    );
-
-    if (stbi_write_png(filenameOut, width,
-                       height, comp, pixelsOut, 0) == 0)
+    if (typeOut != type)
+    {
+        pixelsWrite = malloc((size_t) height * width * comp * pixelTypeSize(typeOut));
+
+        if (pixelsWrite == NULL)
+        {
+            printf("Could not allocate enough memory.\n");
+            stbi_image_free(mask);
+            stbi_image_free(map);
+            freeShape(shape);
+            free(pixelsIn);
+            free(pixelsOut);
+            return 1;
+        }
+
+        convertPixels(pixelsResult, type, pixelsWrite, typeOut, height * width * comp);
+    }
+
+    int written;
+
+    if (typeOut == PIXEL_F32)
+    {
+        written = stbi_write_hdr(filenameOut, width, height, comp, pixelsWrite);
+    }
+    else if (hasExtension(filenameOut, ".ppm") || hasExtension(filenameOut, ".pgm"))
+    {
+        written = writePNM(filenameOut, width, height, comp, typeOut, pixelsWrite);
+    }
+    else
+    {
+        written = stbi_write_png(filenameOut, width,
+                                 height, comp, pixelsWrite, 0);
+    }
+
+    if (written == 0)
     {
         printf("Could not write \"%s\"\n", filenameOut);
     }
@@ -101,6 +527,19 @@ int main(int argc, char **argv)
             filenameOut);
     }
 
+    if (pixelsWrite != pixelsResult)
+    {
+        free(pixelsWrite);
+    }
+
+    setMask(NULL);
+    setShape(NULL);
+    stbi_image_free(mask);
+    stbi_image_free(map);
+    freeShape(shape);
+    free(areas);
+    free(discs);
+    free(polygon);
     free(pixelsIn);
     free(pixelsOut);
     free(filenameIn);
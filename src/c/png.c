@@ -0,0 +1,222 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "blur.h"
+#include "png.h"
+
+/* Bytes of a stored deflate block at most */
+#define STORED_SIZE 65535
+
+
+static void putBig32(uint8_t *out, const uint32_t value)
+{
+  out[0] = (uint8_t) (value >> 24);
+  out[1] = (uint8_t) (value >> 16);
+  out[2] = (uint8_t) (value >> 8);
+  out[3] = (uint8_t) value;
+}
+
+
+static uint32_t updateCrc(const PNGFile *png,
+                          uint32_t crc,
+                          const uint8_t *data,
+                          const size_t size)
+{
+  for (size_t i = 0; i < size; i++)
+  {
+    crc = png->crcTable[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+  }
+
+  return crc;
+}
+
+
+/* Adler-32, in runs short enough for the sums not to overflow */
+static uint32_t updateAdler(uint32_t adler, const uint8_t *data, size_t size)
+{
+  uint32_t a = adler & 0xffff;
+  uint32_t b = adler >> 16;
+
+  while (size > 0)
+  {
+    size_t run = size < 5552 ? size : 5552;
+
+    for (size_t i = 0; i < run; i++)
+    {
+      a += data[i];
+      b += a;
+    }
+
+    a %= 65521;
+    b %= 65521;
+    data += run;
+    size -= run;
+  }
+
+  return b << 16 | a;
+}
+
+
+/* Length, type, data and crc of a chunk; the data in up to two parts */
+static bool writeChunk(PNGFile *png,
+                       const char *type,
+                       const uint8_t *head,
+                       const size_t headSize,
+                       const uint8_t *data,
+                       const size_t dataSize)
+{
+  uint8_t prefix[8];
+  putBig32(prefix, (uint32_t) (headSize + dataSize));
+  memcpy(prefix + 4, type, 4);
+
+  uint32_t crc = updateCrc(png, 0xffffffffu, prefix + 4, 4);
+  crc = updateCrc(png, crc, head, headSize);
+  crc = updateCrc(png, crc, data, dataSize);
+
+  uint8_t suffix[4];
+  putBig32(suffix, crc ^ 0xffffffffu);
+
+  return fwrite(prefix, 1, 8, png->file) == 8
+    && (headSize == 0 || fwrite(head, 1, headSize, png->file) == headSize)
+    && (dataSize == 0 || fwrite(data, 1, dataSize, png->file) == dataSize)
+    && fwrite(suffix, 1, 4, png->file) == 4;
+}
+
+
+bool createPNG(PNGFile *png,
+               const char *filename,
+               const int width,
+               const int height,
+               const int components,
+               const PixelType type)
+{
+  static const uint8_t colourTypes[] = { 0, 4, 2, 6 };
+  static const uint8_t signature[] = { 137, 'P', 'N', 'G', '\r', '\n', 26, '\n' };
+
+  png->file = NULL;
+  png->line = NULL;
+
+  if (components < 1 || components > 4
+      || (type != PIXEL_U8 && type != PIXEL_U16))
+  {
+    return false;
+  }
+
+  for (uint32_t n = 0; n < 256; n++)
+  {
+    uint32_t c = n;
+
+    for (int k = 0; k < 8; k++)
+    {
+      c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+    }
+
+    png->crcTable[n] = c;
+  }
+
+  png->width = width;
+  png->components = components;
+  png->type = type;
+  png->adler = 1;
+
+  /* Filter byte, then the samples */
+  png->line = (uint8_t *) malloc(1 + (size_t) width * components * pixelTypeSize(type));
+  png->file = png->line != NULL ? fopen(filename, "wb") : NULL;
+
+  if (png->file == NULL)
+  {
+    closePNG(png);
+    return false;
+  }
+
+  uint8_t header[13];
+  putBig32(header, (uint32_t) width);
+  putBig32(header + 4, (uint32_t) height);
+  header[8] = type == PIXEL_U8 ? 8 : 16;
+  header[9] = colourTypes[components - 1];
+  header[10] = 0;   // deflate
+  header[11] = 0;   // adaptive filtering
+  header[12] = 0;   // not interlaced
+
+  /* The zlib header opens the first IDAT; 32k window, no dictionary */
+  static const uint8_t zlib[] = { 0x78, 0x01 };
+
+  if (fwrite(signature, 1, sizeof(signature), png->file) != sizeof(signature)
+      || !writeChunk(png, "IHDR", header, sizeof(header), NULL, 0)
+      || !writeChunk(png, "IDAT", zlib, sizeof(zlib), NULL, 0))
+  {
+    closePNG(png);
+    return false;
+  }
+
+  return true;
+}
+
+
+bool writePNGRow(void *context, const void *row)
+{
+  PNGFile *png = (PNGFile *) context;
+  size_t count = (size_t) png->width * png->components;
+  size_t size = 1 + count * pixelTypeSize(png->type);
+
+  png->line[0] = 0;   // no filter
+
+  if (png->type == PIXEL_U8)
+  {
+    memcpy(png->line + 1, row, count);
+  }
+  else
+  {
+    /* Samples are big-endian */
+    const uint16_t *samples = (const uint16_t *) row;
+
+    for (size_t i = 0; i < count; i++)
+    {
+      png->line[1 + 2 * i] = (uint8_t) (samples[i] >> 8);
+      png->line[2 + 2 * i] = (uint8_t) samples[i];
+    }
+  }
+
+  png->adler = updateAdler(png->adler, png->line, size);
+
+  /* Stored blocks, none of them final, as only closePNG() knows the last */
+  bool ok = true;
+
+  for (size_t offset = 0; ok && offset < size; offset += STORED_SIZE)
+  {
+    size_t block = size - offset < STORED_SIZE ? size - offset : STORED_SIZE;
+    uint8_t head[5] = { 0,
+                        (uint8_t) block, (uint8_t) (block >> 8),
+                        (uint8_t) ~block, (uint8_t) (~block >> 8) };
+
+    ok = writeChunk(png, "IDAT", head, sizeof(head), png->line + offset, block);
+  }
+
+  return ok;
+}
+
+
+bool closePNG(PNGFile *png)
+{
+  bool ok = png->file != NULL;
+
+  if (ok)
+  {
+    /* An empty final block, and the checksum of the zlib stream */
+    uint8_t tail[9] = { 1, 0, 0, 0xff, 0xff };
+    putBig32(tail + 5, png->adler);
+
+    ok = writeChunk(png, "IDAT", tail, sizeof(tail), NULL, 0)
+      && writeChunk(png, "IEND", NULL, 0, NULL, 0);
+    ok = fclose(png->file) == 0 && ok;
+  }
+
+  free(png->line);
+  png->file = NULL;
+  png->line = NULL;
+
+  return ok;
+}
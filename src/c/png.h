@@ -0,0 +1,49 @@
+#include <stdbool.h>
+
+
+/** PNG image, created for writing a row at a time
+ *
+ * Rows are stored, not compressed, such that each is written as soon as
+ * it is given and memory stays at a single row whatever the height.
+ */
+typedef struct
+{
+  FILE *file;
+  int width;
+  int components;     // 1 to 4; grey, grey and alpha, rgb or rgba
+  PixelType type;     // PIXEL_U8 or PIXEL_U16
+  uint32_t adler;     // of the zlib stream so far
+  uint32_t crcTable[256];
+  uint8_t *line;      // a row as stored in the file
+} PNGFile;
+
+
+/** Create a PNG image and write its header
+ *
+ * @param type    PIXEL_U8 or PIXEL_U16, for a bit depth of 8 or 16
+ * @returns       false if the file cannot be created
+ */
+bool createPNG(PNGFile *png,
+               const char *filename,
+               const int width,
+               const int height,
+               const int components,
+               const PixelType type);
+
+
+/** Write the next row of an image created by createPNG()
+ *
+ * Each row goes out as its own IDAT chunk of stored deflate blocks,
+ * unfiltered.
+ *
+ * @param png     a PNGFile
+ * @param row     width * components samples of png->type
+ */
+bool writePNGRow(void *png, const void *row);
+
+
+/** Finish the zlib stream, write the trailer and close the image
+ *
+ * @returns       whether everything written made it to the file
+ */
+bool closePNG(PNGFile *png);
@@ -0,0 +1,259 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <ctype.h>
+
+#include "blur.h"
+#include "pnm.h"
+
+
+/* Next number of the header, skipping whitespace and comments */
+static int readNumber(FILE *file)
+{
+  int c = fgetc(file);
+
+  while (c == '#' || isspace(c))
+  {
+    if (c == '#')
+    {
+      while (c != '\n' && c != EOF)
+      {
+        c = fgetc(file);
+      }
+    }
+
+    c = fgetc(file);
+  }
+
+  int number = 0;
+  bool any = false;
+
+  while (isdigit(c) && number < 1 << 24)
+  {
+    number = number * 10 + (c - '0');
+    any = true;
+    c = fgetc(file);
+  }
+
+  /* A single whitespace separates the header from the samples */
+  return any && (c == EOF || isspace(c)) ? number : -1;
+}
+
+
+/* Bytes of a row as stored in the file */
+static size_t lineSize(const PNMFile *pnm)
+{
+  return (size_t) pnm->width * pnm->components * (pnm->maxval > 255 ? 2 : 1);
+}
+
+
+bool openPNM(PNMFile *pnm, const char *filename)
+{
+  pnm->file = fopen(filename, "rb");
+  pnm->line = NULL;
+
+  if (pnm->file == NULL)
+  {
+    return false;
+  }
+
+  char magic[2];
+
+  if (fread(magic, 1, 2, pnm->file) == 2 && magic[0] == 'P'
+      && (magic[1] == '5' || magic[1] == '6'))
+  {
+    pnm->width = readNumber(pnm->file);
+    pnm->height = readNumber(pnm->file);
+    pnm->maxval = readNumber(pnm->file);
+    pnm->components = magic[1] == '5' ? 1 : 3;
+    pnm->type = pnm->maxval > 255 ? PIXEL_U16 : PIXEL_U8;
+
+    if (pnm->width > 0 && pnm->height > 0
+        && pnm->maxval > 0 && pnm->maxval < 65536
+        && (size_t) pnm->width * pnm->height < (size_t) (INT32_MAX / 3))
+    {
+      pnm->line = (uint8_t *) malloc(lineSize(pnm));
+    }
+  }
+
+  if (pnm->line == NULL)
+  {
+    fclose(pnm->file);
+    pnm->file = NULL;
+    return false;
+  }
+
+  return true;
+}
+
+
+bool readPNMRow(void *context, void *row)
+{
+  PNMFile *pnm = (PNMFile *) context;
+  size_t count = (size_t) pnm->width * pnm->components;
+  const uint8_t *bytes = pnm->line;
+  uint32_t maxval = pnm->maxval;
+
+  if (fread(pnm->line, 1, lineSize(pnm), pnm->file) != lineSize(pnm))
+  {
+    return false;
+  }
+
+  if (pnm->type == PIXEL_U16)
+  {
+    uint16_t *samples = (uint16_t *) row;
+
+    for (size_t i = 0; i < count; i++)
+    {
+      uint32_t value = (uint32_t) bytes[2 * i] << 8 | bytes[2 * i + 1];
+      samples[i] = (uint16_t) ((value * 65535 + maxval / 2) / maxval);
+    }
+  }
+  else
+  {
+    uint8_t *samples = (uint8_t *) row;
+
+    for (size_t i = 0; i < count; i++)
+    {
+      samples[i] = maxval == 255
+        ? bytes[i]
+        : (uint8_t) ((bytes[i] * 255 + maxval / 2) / maxval);
+    }
+  }
+
+  return true;
+}
+
+
+bool createPNM(PNMFile *pnm,
+               const char *filename,
+               const int width,
+               const int height,
+               const int components,
+               const PixelType type)
+{
+  pnm->file = NULL;
+  pnm->line = NULL;
+
+  if ((components != 1 && components != 3)
+      || (type != PIXEL_U8 && type != PIXEL_U16))
+  {
+    return false;
+  }
+
+  pnm->width = width;
+  pnm->height = height;
+  pnm->components = components;
+  pnm->type = type;
+  pnm->maxval = type == PIXEL_U8 ? 255 : 65535;
+  pnm->line = (uint8_t *) malloc(lineSize(pnm));
+  pnm->file = pnm->line != NULL ? fopen(filename, "wb") : NULL;
+
+  if (pnm->file == NULL
+      || fprintf(pnm->file, "P%c\n%i %i\n%i\n", components == 1 ? '5' : '6',
+                 width, height, pnm->maxval) < 0)
+  {
+    closePNM(pnm);
+    return false;
+  }
+
+  return true;
+}
+
+
+bool writePNMRow(void *context, const void *row)
+{
+  PNMFile *pnm = (PNMFile *) context;
+  size_t count = (size_t) pnm->width * pnm->components;
+
+  if (pnm->type == PIXEL_U8)
+  {
+    return fwrite(row, 1, count, pnm->file) == count;
+  }
+
+  /* Samples are big-endian */
+  const uint16_t *samples = (const uint16_t *) row;
+
+  for (size_t i = 0; i < count; i++)
+  {
+    pnm->line[2 * i] = (uint8_t) (samples[i] >> 8);
+    pnm->line[2 * i + 1] = (uint8_t) samples[i];
+  }
+
+  return fwrite(pnm->line, 2, count, pnm->file) == count;
+}
+
+
+bool closePNM(PNMFile *pnm)
+{
+  bool ok = pnm->file != NULL && fclose(pnm->file) == 0;
+
+  free(pnm->line);
+  pnm->file = NULL;
+  pnm->line = NULL;
+
+  return ok;
+}
+
+
+void *loadPNM(const char *filename,
+              int *width,
+              int *height,
+              int *components,
+              PixelType *type)
+{
+  PNMFile pnm;
+
+  if (!openPNM(&pnm, filename))
+  {
+    return NULL;
+  }
+
+  size_t stride = (size_t) pnm.width * pnm.components * pixelTypeSize(pnm.type);
+  uint8_t *pixels = (uint8_t *) malloc(stride * pnm.height);
+
+  for (int y = 0; pixels != NULL && y < pnm.height; y++)
+  {
+    if (!readPNMRow(&pnm, pixels + y * stride))
+    {
+      free(pixels);
+      pixels = NULL;
+    }
+  }
+
+  *width = pnm.width;
+  *height = pnm.height;
+  *components = pnm.components;
+  *type = pnm.type;
+
+  closePNM(&pnm);
+
+  return pixels;
+}
+
+
+bool writePNM(const char *filename,
+              const int width,
+              const int height,
+              const int components,
+              const PixelType type,
+              const void *pixels)
+{
+  PNMFile pnm;
+
+  if (!createPNM(&pnm, filename, width, height, components, type))
+  {
+    return false;
+  }
+
+  size_t stride = (size_t) width * components * pixelTypeSize(type);
+  bool ok = true;
+
+  for (int y = 0; ok && y < height; y++)
+  {
+    ok = writePNMRow(&pnm, (const uint8_t *) pixels + y * stride);
+  }
+
+  return closePNM(&pnm) && ok;
+}
@@ -0,0 +1,95 @@
+#include <stdbool.h>
+
+
+/** Binary netpbm image, P5 (grey) or P6 (rgb), open for reading or
+ *  writing a row at a time
+ */
+typedef struct
+{
+  FILE *file;
+  int width;
+  int height;
+  int components;     // 1 or 3
+  PixelType type;     // PIXEL_U8, or PIXEL_U16 for a maxval above 255
+  int maxval;         // of samples in the file
+  uint8_t *line;      // a row as stored in the file
+} PNMFile;
+
+
+/** Open a netpbm image and read its header
+ *
+ * @returns           false if the file is not a P5 or P6 image
+ */
+bool openPNM(PNMFile *pnm, const char *filename);
+
+
+/** Read the next row of an image opened by openPNM()
+ *
+ * Samples are scaled to the full range of their type, such that a 16-bit
+ * sample is in native byte order and 0 to 65535 whatever the maxval.
+ *
+ * @param pnm     a PNMFile
+ * @param row     width * components samples of pnm->type
+ * @returns       false if the file ends before the row does
+ */
+bool readPNMRow(void *pnm, void *row);
+
+
+/** Create a netpbm image and write its header, P5 for 1 component and
+ *  P6 for 3, with a maxval of 255 for PIXEL_U8 and 65535 for PIXEL_U16
+ */
+bool createPNM(PNMFile *pnm,
+               const char *filename,
+               const int width,
+               const int height,
+               const int components,
+               const PixelType type);
+
+
+/** Write the next row of an image created by createPNM()
+ *
+ * @param pnm     a PNMFile
+ * @param row     width * components samples of pnm->type
+ */
+bool writePNMRow(void *pnm, const void *row);
+
+
+/** Close an image opened or created
+ *
+ * @returns       whether everything written made it to the file
+ */
+bool closePNM(PNMFile *pnm);
+
+
+/** Load a binary netpbm image, P5 (grey) or P6 (rgb)
+ *
+ * Unlike stb_image, samples with a maxval above 255 are kept at 16 bits,
+ * stored big-endian in the file and as native uint16_t in memory. Samples
+ * are scaled to the full range of their type.
+ *
+ * @param filename    path to a .pgm or .ppm
+ * @param width       of image
+ * @param height      of image
+ * @param components  1 or 3
+ * @param type        PIXEL_U8 or PIXEL_U16
+ * @returns           pixels, to be free()'d, or NULL on failure
+ */
+void *loadPNM(const char *filename,
+              int *width,
+              int *height,
+              int *components,
+              PixelType *type);
+
+
+/** Write a binary netpbm image, P5 for 1 component and P6 for 3
+ *
+ * @param type    PIXEL_U8 or PIXEL_U16, written with a maxval of 255
+ *                or 65535 respectively
+ * @returns       whether the whole image was written
+ */
+bool writePNM(const char *filename,
+              const int width,
+              const int height,
+              const int components,
+              const PixelType type,
+              const void *pixels);
@@ -0,0 +1,311 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifndef _MSC_VER
+#include <pthread.h>
+#include <unistd.h>
+#define POOL_PTHREADS 1
+#endif
+
+#include "blur.h"
+#include "pool.h"
+
+/* Bands per thread, such that there is something left to steal */
+#define BANDS_PER_THREAD 4
+
+#define MAX_THREADS 256
+
+
+#ifdef POOL_PTHREADS
+
+/* Bands not yet taken, of which the owner takes from the front and
+   thieves take from the back */
+typedef struct
+{
+  pthread_mutex_t lock;
+  int begin;
+  int end;
+} Deque;
+
+
+static struct
+{
+  pthread_mutex_t lock;
+  pthread_cond_t start;         // signalled on a new job, or on quit
+  pthread_cond_t done;          // signalled on the last band of a job
+
+  pthread_t threads[MAX_THREADS];
+  Deque deques[MAX_THREADS];
+  int count;                    // threads, including the caller
+  bool quit;
+
+  /* Current job */
+  RangeTask task;
+  void *context;
+  int total;                    // length of range
+  int bands;
+  int remaining;                // bands not yet done
+  int generation;               // incremented per job
+  bool busy;
+} pool;
+
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+
+
+/* Take a band from the front of a deque, or steal one from its back */
+static int take(Deque *deque, const bool steal)
+{
+  int band = -1;
+
+  pthread_mutex_lock(&deque->lock);
+
+  if (deque->begin < deque->end)
+  {
+    band = steal ? --deque->end : deque->begin++;
+  }
+
+  pthread_mutex_unlock(&deque->lock);
+
+  return band;
+}
+
+
+/* Run bands of the current job until none are left anywhere */
+static void work(const int self)
+{
+  int count = pool.count;
+
+  for (;;)
+  {
+    int band = take(&pool.deques[self], false);
+
+    for (int i = 1; band < 0 && i < count; i++)
+    {
+      band = take(&pool.deques[(self + i) % count], true);
+    }
+
+    if (band < 0)
+    {
+      return;
+    }
+
+    int first = (int) ((int64_t) band * pool.total / pool.bands);
+    int last = (int) ((int64_t) (band + 1) * pool.total / pool.bands);
+
+    pool.task(pool.context, first, last);
+
+    pthread_mutex_lock(&pool.lock);
+    if (--pool.remaining == 0)
+    {
+      pthread_cond_signal(&pool.done);
+    }
+    pthread_mutex_unlock(&pool.lock);
+  }
+}
+
+
+static void *worker(void *argument)
+{
+  int self = (int) (intptr_t) argument;
+  int generation = 0;
+
+  for (;;)
+  {
+    pthread_mutex_lock(&pool.lock);
+
+    while (!pool.quit && pool.generation == generation)
+    {
+      pthread_cond_wait(&pool.start, &pool.lock);
+    }
+
+    if (pool.quit)
+    {
+      pthread_mutex_unlock(&pool.lock);
+      return NULL;
+    }
+
+    generation = pool.generation;
+    pthread_mutex_unlock(&pool.lock);
+
+    work(self);
+  }
+}
+
+
+static void stopThreads(void)
+{
+  pthread_mutex_lock(&pool.lock);
+  pool.quit = true;
+  pthread_cond_broadcast(&pool.start);
+  pthread_mutex_unlock(&pool.lock);
+
+  for (int i = 1; i < pool.count; i++)
+  {
+    pthread_join(pool.threads[i], NULL);
+  }
+
+  pool.quit = false;
+  pool.count = 1;
+}
+
+
+static bool startThreads(const int count)
+{
+  pool.count = 1;
+  pool.generation = 0;
+
+  for (int i = 1; i < count; i++)
+  {
+    if (pthread_create(&pool.threads[i], NULL, worker, (void *) (intptr_t) i) != 0)
+    {
+      stopThreads();
+      return false;
+    }
+
+    pool.count++;
+  }
+
+  return true;
+}
+
+
+static void initialise(void)
+{
+  pthread_mutex_init(&pool.lock, NULL);
+  pthread_cond_init(&pool.start, NULL);
+  pthread_cond_init(&pool.done, NULL);
+
+  for (int i = 0; i < MAX_THREADS; i++)
+  {
+    pthread_mutex_init(&pool.deques[i].lock, NULL);
+  }
+
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  cpus = cpus < 1 ? 1 : cpus > MAX_THREADS ? MAX_THREADS : cpus;
+
+  startThreads((int) cpus);
+}
+
+
+bool setThreadCount(const int count)
+{
+  pthread_once(&once, initialise);
+
+  long target = count;
+  if (target < 1)
+  {
+    target = sysconf(_SC_NPROCESSORS_ONLN);
+  }
+
+  target = target < 1 ? 1 : target > MAX_THREADS ? MAX_THREADS : target;
+
+  pthread_mutex_lock(&pool.lock);
+  if (pool.busy)
+  {
+    pthread_mutex_unlock(&pool.lock);
+    return false;
+  }
+  pool.busy = true;
+  pthread_mutex_unlock(&pool.lock);
+
+  stopThreads();
+  bool ok = startThreads((int) target);
+
+  pthread_mutex_lock(&pool.lock);
+  pool.busy = false;
+  pthread_mutex_unlock(&pool.lock);
+
+  return ok;
+}
+
+
+int threadCount(void)
+{
+  pthread_once(&once, initialise);
+
+  return pool.count;
+}
+
+
+void parallelFor(const int count, RangeTask task, void *context)
+{
+  if (count <= 0)
+  {
+    return;
+  }
+
+  pthread_once(&once, initialise);
+
+  pthread_mutex_lock(&pool.lock);
+
+  if (pool.busy || pool.count == 1 || count == 1)
+  {
+    pthread_mutex_unlock(&pool.lock);
+    task(context, 0, count);
+    return;
+  }
+
+  int bands = pool.count * BANDS_PER_THREAD;
+  bands = bands > count ? count : bands;
+
+  pool.busy = true;
+  pool.task = task;
+  pool.context = context;
+  pool.total = count;
+  pool.bands = bands;
+  pool.remaining = bands;
+
+  /* Contiguous bands per thread, for locality */
+  for (int i = 0; i < pool.count; i++)
+  {
+    Deque *deque = &pool.deques[i];
+    pthread_mutex_lock(&deque->lock);
+    deque->begin = i * bands / pool.count;
+    deque->end = (i + 1) * bands / pool.count;
+    pthread_mutex_unlock(&deque->lock);
+  }
+
+  pool.generation++;
+  pthread_cond_broadcast(&pool.start);
+  pthread_mutex_unlock(&pool.lock);
+
+  /* The caller works too */
+  work(0);
+
+  pthread_mutex_lock(&pool.lock);
+  while (pool.remaining > 0)
+  {
+    pthread_cond_wait(&pool.done, &pool.lock);
+  }
+  pool.busy = false;
+  pthread_mutex_unlock(&pool.lock);
+}
+
+#else
+
+/* Without pthreads, everything runs on the calling thread */
+
+bool setThreadCount(const int count)
+{
+  return count <= 1;
+}
+
+
+int threadCount(void)
+{
+  return 1;
+}
+
+
+void parallelFor(const int count, RangeTask task, void *context)
+{
+  if (count > 0)
+  {
+    task(context, 0, count);
+  }
+}
+
+#endif
@@ -0,0 +1,19 @@
+/** Work on rows /p first up to /p last of a range
+ */
+typedef void (*RangeTask)(void *context, const int first, const int last);
+
+
+/** Run /p task over the range 0 to /p count on the shared thread pool
+ *
+ * The range is split into bands, more than there are threads, which are
+ * handed out to each thread up front. A thread that runs out of bands
+ * steals from the end of another's, such that uneven bands even out.
+ *
+ *   thread 0   [0 1 2 3]
+ *   thread 1   [4 5 6 7]  <-- steals 3
+ *
+ * Returns once all bands are done. Bands may run in any order and on any
+ * thread, so tasks must write disjoint memory. When called from within a
+ * task, or while the pool is busy, the range runs on the calling thread.
+ */
+void parallelFor(const int count, RangeTask task, void *context);
@@ -0,0 +1,381 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "blur.h"
+
+
+/* Shape being built a row at a time, from runs given in order of their
+   first column; runs that overlap or touch are merged */
+typedef struct
+{
+  Shape *shape;
+  int count;          // runs so far
+  int capacity;       // runs allocated
+  int row;            // being built
+} Builder;
+
+
+static bool startShape(Builder *builder, const int width, const int height)
+{
+  builder->count = 0;
+  builder->capacity = height > 16 ? height : 16;
+  builder->row = 0;
+  builder->shape = (Shape *) malloc(sizeof(Shape));
+
+  if (builder->shape == NULL)
+  {
+    return false;
+  }
+
+  Shape *shape = builder->shape;
+  shape->width = width;
+  shape->height = height;
+  shape->rows = (int *) malloc((height + 1) * sizeof(int));
+  shape->runs = (int *) malloc(2 * builder->capacity * sizeof(int));
+
+  if (shape->rows == NULL || shape->runs == NULL)
+  {
+    freeShape(shape);
+    return false;
+  }
+
+  shape->rows[0] = 0;
+
+  return true;
+}
+
+
+/* Add a run to the current row, clipped to the image */
+static bool addRun(Builder *builder, const int begin, const int end)
+{
+  Shape *shape = builder->shape;
+  int first = begin > 0 ? begin : 0;
+  int last = end < shape->width ? end : shape->width;
+
+  if (first >= last)
+  {
+    return true;
+  }
+
+  /* Merged with the previous run of the row, if it reaches this one */
+  if (builder->count > shape->rows[builder->row])
+  {
+    int *previous = shape->runs + 2 * (builder->count - 1);
+
+    if (first <= previous[1])
+    {
+      previous[1] = last > previous[1] ? last : previous[1];
+      return true;
+    }
+  }
+
+  if (builder->count == builder->capacity)
+  {
+    int *grown = (int *) realloc(shape->runs,
+                                 4 * builder->capacity * sizeof(int));
+
+    if (grown == NULL)
+    {
+      return false;
+    }
+
+    shape->runs = grown;
+    builder->capacity *= 2;
+  }
+
+  shape->runs[2 * builder->count] = first;
+  shape->runs[2 * builder->count + 1] = last;
+  builder->count++;
+
+  return true;
+}
+
+
+static void endRow(Builder *builder)
+{
+  builder->shape->rows[++builder->row] = builder->count;
+}
+
+
+static int compareRuns(const void *a, const void *b)
+{
+  const int *x = (const int *) a;
+  const int *y = (const int *) b;
+
+  return (x[0] > y[0]) - (x[0] < y[0]);
+}
+
+
+/* Add runs of any order to the current row; /p runs is sorted in place */
+static bool addRuns(Builder *builder, int *runs, const int count)
+{
+  qsort(runs, count, 2 * sizeof(int), compareRuns);
+
+  for (int i = 0; i < count; i++)
+  {
+    if (!addRun(builder, runs[2 * i], runs[2 * i + 1]))
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+
+Shape *shapeFromMask(const uint8_t *mask, const int width, const int height)
+{
+  Builder builder;
+
+  if (!startShape(&builder, width, height))
+  {
+    return NULL;
+  }
+
+  for (int h = 0; h < height; h++)
+  {
+    const uint8_t *row = mask + (size_t) h * width;
+
+    for (int w = 0; w < width; w++)
+    {
+      if (row[w] == 0)
+      {
+        continue;
+      }
+
+      int begin = w;
+      while (w < width && row[w] != 0)
+      {
+        w++;
+      }
+
+      if (!addRun(&builder, begin, w))
+      {
+        freeShape(builder.shape);
+        return NULL;
+      }
+    }
+
+    endRow(&builder);
+  }
+
+  return builder.shape;
+}
+
+
+Shape *shapeFromCircles(const double *circles,
+                        const int count,
+                        const int width,
+                        const int height)
+{
+  Builder builder;
+  int *runs = (int *) malloc(2 * (count > 0 ? count : 1) * sizeof(int));
+
+  if (runs == NULL || !startShape(&builder, width, height))
+  {
+    free(runs);
+    return NULL;
+  }
+
+  for (int h = 0; h < height; h++)
+  {
+    int found = 0;
+
+    /* Chord of each circle through the row; pixels whose center lies
+       within the circle are covered */
+    for (int i = 0; i < count; i++)
+    {
+      double x = circles[3 * i];
+      double dy = h - circles[3 * i + 1];
+      double radius = circles[3 * i + 2];
+      double squared = radius * radius - dy * dy;
+
+      if (squared < 0)
+      {
+        continue;
+      }
+
+      double half = sqrt(squared);
+      runs[2 * found] = (int) ceil(x - half);
+      runs[2 * found + 1] = (int) floor(x + half) + 1;
+      found++;
+    }
+
+    if (!addRuns(&builder, runs, found))
+    {
+      free(runs);
+      freeShape(builder.shape);
+      return NULL;
+    }
+
+    endRow(&builder);
+  }
+
+  free(runs);
+
+  return builder.shape;
+}
+
+
+Shape *shapeFromPolygon(const double *points,
+                        const int count,
+                        const int width,
+                        const int height)
+{
+  Builder builder;
+  double *crossings = (double *) malloc((count > 0 ? count : 1) * sizeof(double));
+  int *runs = (int *) malloc((count > 0 ? count : 1) * sizeof(int));
+
+  if (crossings == NULL || runs == NULL || !startShape(&builder, width, height))
+  {
+    free(crossings);
+    free(runs);
+    return NULL;
+  }
+
+  for (int h = 0; h < height; h++)
+  {
+    int found = 0;
+
+    /* Crossings of the edges with the centers of the row, each edge
+       taken as half open such that vertices are not counted twice */
+    for (int i = 0; i < count; i++)
+    {
+      const double *a = points + 2 * i;
+      const double *b = points + 2 * ((i + 1) % count);
+
+      if ((a[1] <= h && h < b[1]) || (b[1] <= h && h < a[1]))
+      {
+        crossings[found++] = a[0] + (h - a[1]) * (b[0] - a[0]) / (b[1] - a[1]);
+      }
+    }
+
+    /* Even-odd rule; the centers between each pair are inside */
+    for (int i = 1; i < found; i++)
+    {
+      double x = crossings[i];
+      int j = i;
+
+      for (; j > 0 && crossings[j - 1] > x; j--)
+      {
+        crossings[j] = crossings[j - 1];
+      }
+
+      crossings[j] = x;
+    }
+
+    for (int i = 0; i + 1 < found; i += 2)
+    {
+      runs[i] = (int) ceil(crossings[i]);
+      runs[i + 1] = (int) ceil(crossings[i + 1]);
+    }
+
+    if (!addRuns(&builder, runs, found / 2))
+    {
+      free(crossings);
+      free(runs);
+      freeShape(builder.shape);
+      return NULL;
+    }
+
+    endRow(&builder);
+  }
+
+  free(crossings);
+  free(runs);
+
+  return builder.shape;
+}
+
+
+Shape *shapeUnion(const Shape *a, const Shape *b)
+{
+  if (a->width != b->width || a->height != b->height)
+  {
+    return NULL;
+  }
+
+  Builder builder;
+
+  if (!startShape(&builder, a->width, a->height))
+  {
+    return NULL;
+  }
+
+  for (int h = 0; h < a->height; h++)
+  {
+    int i = a->rows[h];
+    int j = b->rows[h];
+
+    /* Merge of two sorted lists */
+    while (i < a->rows[h + 1] || j < b->rows[h + 1])
+    {
+      bool fromA = j == b->rows[h + 1]
+        || (i < a->rows[h + 1] && a->runs[2 * i] <= b->runs[2 * j]);
+      const int *run = fromA ? a->runs + 2 * i++ : b->runs + 2 * j++;
+
+      if (!addRun(&builder, run[0], run[1]))
+      {
+        freeShape(builder.shape);
+        return NULL;
+      }
+    }
+
+    endRow(&builder);
+  }
+
+  return builder.shape;
+}
+
+
+bool shapeBounds(const Shape *shape,
+                 int *minX,
+                 int *minY,
+                 int *maxX,
+                 int *maxY)
+{
+  bool found = false;
+
+  for (int h = 0; h < shape->height; h++)
+  {
+    int first = shape->rows[h];
+    int last = shape->rows[h + 1];
+
+    if (first == last)
+    {
+      continue;
+    }
+
+    int begin = shape->runs[2 * first];
+    int end = shape->runs[2 * last - 1] - 1;
+
+    if (!found)
+    {
+      *minX = begin;
+      *maxX = end;
+      *minY = h;
+    }
+
+    *minX = begin < *minX ? begin : *minX;
+    *maxX = end > *maxX ? end : *maxX;
+    *maxY = h;
+    found = true;
+  }
+
+  return found;
+}
+
+
+void freeShape(Shape *shape)
+{
+  if (shape == NULL)
+  {
+    return;
+  }
+
+  free(shape->rows);
+  free(shape->runs);
+  free(shape);
+}
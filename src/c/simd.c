@@ -0,0 +1,682 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "blur.h"
+#include "simd.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define SIMD_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+/* GCC and Clang only emit instructions of a function's own target, which
+   is what lets one binary carry every variant. MSVC emits any of them. */
+#if defined(__GNUC__)
+#define TARGET(isa) __attribute__((target(isa)))
+#else
+#define TARGET(isa)
+#endif
+
+
+static int16_t saturate16(const int32_t v)
+{
+  return (int16_t) (v < INT16_MIN ? INT16_MIN : v > INT16_MAX ? INT16_MAX : v);
+}
+
+
+static uint8_t saturate8(const int32_t v)
+{
+  return (uint8_t) (v < 0 ? 0 : v > 255 ? 255 : v);
+}
+
+
+/* Scalar
+ *
+ * The reference for every other variant, and what finishes off the
+ * values at the end of a row that do not fill a whole vector.
+ */
+static void horizontalScalar(const uint8_t *source,
+                             int16_t *target,
+                             const int16_t *weights,
+                             const int kernelSize,
+                             const int components,
+                             const int first,
+                             const int count)
+{
+  for (int i = first; i < count; i++)
+  {
+    int32_t sum = 1 << (FIXED_INTERMEDIATE - 1);
+
+    for (int t = 0; t < kernelSize; t++)
+    {
+      sum += weights[t] * source[i + t * components];
+    }
+
+    target[i] = saturate16(sum >> FIXED_INTERMEDIATE);
+  }
+}
+
+
+static void verticalScalar(const int16_t *const *rows,
+                           uint8_t *target,
+                           const int16_t *weights,
+                           const int kernelSize,
+                           const int first,
+                           const int count)
+{
+  const int shift = 2 * FIXED_SHIFT - FIXED_INTERMEDIATE;
+
+  for (int i = first; i < count; i++)
+  {
+    int32_t sum = 1 << (shift - 1);
+
+    for (int t = 0; t < kernelSize; t++)
+    {
+      sum += weights[t] * rows[t][i];
+    }
+
+    target[i] = saturate8(sum >> shift);
+  }
+}
+
+
+static void fullScalar(const uint8_t *const *rows,
+                       uint8_t *target,
+                       const int16_t *weights,
+                       const int kernelSize,
+                       const int components,
+                       const int first,
+                       const int count)
+{
+  for (int i = first; i < count; i++)
+  {
+    int32_t sum = 1 << (FIXED_SHIFT - 1);
+
+    for (int r = 0; r < kernelSize; r++)
+    {
+      const int16_t *row = weights + r * kernelSize;
+
+      for (int t = 0; t < kernelSize; t++)
+      {
+        sum += row[t] * rows[r][i + t * components];
+      }
+    }
+
+    target[i] = saturate8(sum >> FIXED_SHIFT);
+  }
+}
+
+
+static void splitScalar(const uint8_t *source,
+                        uint8_t *const *planes,
+                        const int components,
+                        const int first,
+                        const int count)
+{
+  for (int c = 0; c < components; c++)
+  {
+    uint8_t *plane = planes[c];
+
+    for (int i = first; i < count; i++)
+    {
+      plane[i] = source[i * components + c];
+    }
+  }
+}
+
+
+static void mergeScalar(const uint8_t *const *planes,
+                        uint8_t *target,
+                        const int components,
+                        const int first,
+                        const int count)
+{
+  for (int c = 0; c < components; c++)
+  {
+    const uint8_t *plane = planes[c];
+
+    for (int i = first; i < count; i++)
+    {
+      target[i * components + c] = plane[i];
+    }
+  }
+}
+
+
+#ifdef SIMD_X86
+
+/* Pairs of weights, as multiplied by _mm_madd_epi16()
+
+Taps are processed two at a time by interleaving the samples of tap t
+and t + 1, such that one multiply-add covers both. An odd tap count
+pairs its last tap with a weight of zero.
+
+ samples   t0 t1 t0 t1 t0 t1 t0 t1
+ weights   w0 w1 w0 w1 w0 w1 w0 w1
+           \___/ \___/ \___/ \___/
+ sums       i+0   i+1   i+2   i+3
+
+*/
+static int32_t weightPair(const int16_t *weights, const int t, const int count)
+{
+  uint16_t first = (uint16_t) weights[t];
+  uint16_t second = (uint16_t) (t + 1 < count ? weights[t + 1] : 0);
+
+  return (int32_t) ((uint32_t) second << 16 | first);
+}
+
+
+/* SSE4.1, 8 values at a time */
+TARGET("sse4.1")
+static void horizontalSSE41(const uint8_t *source,
+                            int16_t *target,
+                            const int16_t *weights,
+                            const int kernelSize,
+                            const int components,
+                            const int first,
+                            const int count)
+{
+  const __m128i round = _mm_set1_epi32(1 << (FIXED_INTERMEDIATE - 1));
+  int i = first;
+
+  for (; i + 8 <= count; i += 8)
+  {
+    __m128i low = round, high = round;
+
+    for (int t = 0; t < kernelSize; t += 2)
+    {
+      const uint8_t *sample = source + i + t * components;
+      __m128i a = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i *) sample));
+      __m128i b = t + 1 < kernelSize
+        ? _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i *) (sample + components)))
+        : _mm_setzero_si128();
+      __m128i w = _mm_set1_epi32(weightPair(weights, t, kernelSize));
+
+      low = _mm_add_epi32(low, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), w));
+      high = _mm_add_epi32(high, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), w));
+    }
+
+    low = _mm_srai_epi32(low, FIXED_INTERMEDIATE);
+    high = _mm_srai_epi32(high, FIXED_INTERMEDIATE);
+    _mm_storeu_si128((__m128i *) (target + i), _mm_packs_epi32(low, high));
+  }
+
+  horizontalScalar(source, target, weights, kernelSize, components, i, count);
+}
+
+
+TARGET("sse4.1")
+static void verticalSSE41(const int16_t *const *rows,
+                          uint8_t *target,
+                          const int16_t *weights,
+                          const int kernelSize,
+                          const int first,
+                          const int count)
+{
+  const int shift = 2 * FIXED_SHIFT - FIXED_INTERMEDIATE;
+  const __m128i round = _mm_set1_epi32(1 << (shift - 1));
+  int i = first;
+
+  for (; i + 8 <= count; i += 8)
+  {
+    __m128i low = round, high = round;
+
+    for (int t = 0; t < kernelSize; t += 2)
+    {
+      __m128i a = _mm_loadu_si128((const __m128i *) (rows[t] + i));
+      __m128i b = t + 1 < kernelSize
+        ? _mm_loadu_si128((const __m128i *) (rows[t + 1] + i))
+        : _mm_setzero_si128();
+      __m128i w = _mm_set1_epi32(weightPair(weights, t, kernelSize));
+
+      low = _mm_add_epi32(low, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), w));
+      high = _mm_add_epi32(high, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), w));
+    }
+
+    low = _mm_srai_epi32(low, shift);
+    high = _mm_srai_epi32(high, shift);
+
+    __m128i packed = _mm_packs_epi32(low, high);
+    _mm_storel_epi64((__m128i *) (target + i), _mm_packus_epi16(packed, packed));
+  }
+
+  verticalScalar(rows, target, weights, kernelSize, i, count);
+}
+
+
+TARGET("sse4.1")
+static void fullSSE41(const uint8_t *const *rows,
+                      uint8_t *target,
+                      const int16_t *weights,
+                      const int kernelSize,
+                      const int components,
+                      const int first,
+                      const int count)
+{
+  const __m128i round = _mm_set1_epi32(1 << (FIXED_SHIFT - 1));
+  int i = first;
+
+  for (; i + 8 <= count; i += 8)
+  {
+    __m128i low = round, high = round;
+
+    for (int r = 0; r < kernelSize; r++)
+    {
+      const int16_t *row = weights + r * kernelSize;
+
+      for (int t = 0; t < kernelSize; t += 2)
+      {
+        const uint8_t *sample = rows[r] + i + t * components;
+        __m128i a = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i *) sample));
+        __m128i b = t + 1 < kernelSize
+          ? _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i *) (sample + components)))
+          : _mm_setzero_si128();
+        __m128i w = _mm_set1_epi32(weightPair(row, t, kernelSize));
+
+        low = _mm_add_epi32(low, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), w));
+        high = _mm_add_epi32(high, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), w));
+      }
+    }
+
+    low = _mm_srai_epi32(low, FIXED_SHIFT);
+    high = _mm_srai_epi32(high, FIXED_SHIFT);
+
+    __m128i packed = _mm_packs_epi32(low, high);
+    _mm_storel_epi64((__m128i *) (target + i), _mm_packus_epi16(packed, packed));
+  }
+
+  fullScalar(rows, target, weights, kernelSize, components, i, count);
+}
+
+
+/* Layouts of 3 and 4 components, 16 pixels at a time
+
+Of 3 components, each plane gathers its bytes from all three vectors
+of a run of 48, one shuffle each, and merging scatters them back.
+
+ source   r g b r g b r g b r g b r g b r | g b r g ..
+ plane    r r r r r r . . . . . . . . . .   (first vector)
+          . . . . . . r r r r r . . . . .   (second vector)
+
+Of 4 components, pixels are grouped by component within each vector
+and the 4 x 4 groups then transposed.
+
+*/
+TARGET("sse4.1")
+static void splitSSE41(const uint8_t *source,
+                       uint8_t *const *planes,
+                       const int components,
+                       const int first,
+                       const int count)
+{
+  int i = first;
+
+  if (components == 3)
+  {
+    const __m128i r0 = _mm_setr_epi8(0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i r1 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1);
+    const __m128i r2 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13);
+    const __m128i g0 = _mm_setr_epi8(1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i g1 = _mm_setr_epi8(-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1);
+    const __m128i g2 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14);
+    const __m128i b0 = _mm_setr_epi8(2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i b1 = _mm_setr_epi8(-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1);
+    const __m128i b2 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15);
+
+    for (; i + 16 <= count; i += 16)
+    {
+      const __m128i *pixel = (const __m128i *) (source + i * 3);
+      __m128i a = _mm_loadu_si128(pixel);
+      __m128i b = _mm_loadu_si128(pixel + 1);
+      __m128i c = _mm_loadu_si128(pixel + 2);
+
+      _mm_storeu_si128((__m128i *) (planes[0] + i),
+        _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, r0), _mm_shuffle_epi8(b, r1)),
+                     _mm_shuffle_epi8(c, r2)));
+      _mm_storeu_si128((__m128i *) (planes[1] + i),
+        _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, g0), _mm_shuffle_epi8(b, g1)),
+                     _mm_shuffle_epi8(c, g2)));
+      _mm_storeu_si128((__m128i *) (planes[2] + i),
+        _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, b0), _mm_shuffle_epi8(b, b1)),
+                     _mm_shuffle_epi8(c, b2)));
+    }
+  }
+  else if (components == 4)
+  {
+    const __m128i group = _mm_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15);
+
+    for (; i + 16 <= count; i += 16)
+    {
+      const __m128i *pixel = (const __m128i *) (source + i * 4);
+      __m128i a = _mm_shuffle_epi8(_mm_loadu_si128(pixel), group);
+      __m128i b = _mm_shuffle_epi8(_mm_loadu_si128(pixel + 1), group);
+      __m128i c = _mm_shuffle_epi8(_mm_loadu_si128(pixel + 2), group);
+      __m128i d = _mm_shuffle_epi8(_mm_loadu_si128(pixel + 3), group);
+
+      __m128i rg0 = _mm_unpacklo_epi32(a, b);
+      __m128i rg1 = _mm_unpacklo_epi32(c, d);
+      __m128i ba0 = _mm_unpackhi_epi32(a, b);
+      __m128i ba1 = _mm_unpackhi_epi32(c, d);
+
+      _mm_storeu_si128((__m128i *) (planes[0] + i), _mm_unpacklo_epi64(rg0, rg1));
+      _mm_storeu_si128((__m128i *) (planes[1] + i), _mm_unpackhi_epi64(rg0, rg1));
+      _mm_storeu_si128((__m128i *) (planes[2] + i), _mm_unpacklo_epi64(ba0, ba1));
+      _mm_storeu_si128((__m128i *) (planes[3] + i), _mm_unpackhi_epi64(ba0, ba1));
+    }
+  }
+
+  splitScalar(source, planes, components, i, count);
+}
+
+
+TARGET("sse4.1")
+static void mergeSSE41(const uint8_t *const *planes,
+                       uint8_t *target,
+                       const int components,
+                       const int first,
+                       const int count)
+{
+  int i = first;
+
+  if (components == 3)
+  {
+    const __m128i r0 = _mm_setr_epi8(0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1, 5);
+    const __m128i g0 = _mm_setr_epi8(-1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1);
+    const __m128i b0 = _mm_setr_epi8(-1, -1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1);
+    const __m128i r1 = _mm_setr_epi8(-1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10, -1);
+    const __m128i g1 = _mm_setr_epi8(5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10);
+    const __m128i b1 = _mm_setr_epi8(-1, 5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1);
+    const __m128i r2 = _mm_setr_epi8(-1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1, -1);
+    const __m128i g2 = _mm_setr_epi8(-1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1);
+    const __m128i b2 = _mm_setr_epi8(10, -1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15);
+
+    for (; i + 16 <= count; i += 16)
+    {
+      __m128i r = _mm_loadu_si128((const __m128i *) (planes[0] + i));
+      __m128i g = _mm_loadu_si128((const __m128i *) (planes[1] + i));
+      __m128i b = _mm_loadu_si128((const __m128i *) (planes[2] + i));
+      __m128i *pixel = (__m128i *) (target + i * 3);
+
+      _mm_storeu_si128(pixel,
+        _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(r, r0), _mm_shuffle_epi8(g, g0)),
+                     _mm_shuffle_epi8(b, b0)));
+      _mm_storeu_si128(pixel + 1,
+        _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(r, r1), _mm_shuffle_epi8(g, g1)),
+                     _mm_shuffle_epi8(b, b1)));
+      _mm_storeu_si128(pixel + 2,
+        _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(r, r2), _mm_shuffle_epi8(g, g2)),
+                     _mm_shuffle_epi8(b, b2)));
+    }
+  }
+  else if (components == 4)
+  {
+    for (; i + 16 <= count; i += 16)
+    {
+      __m128i r = _mm_loadu_si128((const __m128i *) (planes[0] + i));
+      __m128i g = _mm_loadu_si128((const __m128i *) (planes[1] + i));
+      __m128i b = _mm_loadu_si128((const __m128i *) (planes[2] + i));
+      __m128i a = _mm_loadu_si128((const __m128i *) (planes[3] + i));
+      __m128i *pixel = (__m128i *) (target + i * 4);
+
+      __m128i rg0 = _mm_unpacklo_epi8(r, g);
+      __m128i rg1 = _mm_unpackhi_epi8(r, g);
+      __m128i ba0 = _mm_unpacklo_epi8(b, a);
+      __m128i ba1 = _mm_unpackhi_epi8(b, a);
+
+      _mm_storeu_si128(pixel, _mm_unpacklo_epi16(rg0, ba0));
+      _mm_storeu_si128(pixel + 1, _mm_unpackhi_epi16(rg0, ba0));
+      _mm_storeu_si128(pixel + 2, _mm_unpacklo_epi16(rg1, ba1));
+      _mm_storeu_si128(pixel + 3, _mm_unpackhi_epi16(rg1, ba1));
+    }
+  }
+
+  mergeScalar(planes, target, components, i, count);
+}
+
+
+/* AVX2, 16 values at a time
+
+Unpacking and packing both work within each 128-bit half, so the
+interleaving of one is undone by the other and values come out in order.
+
+*/
+TARGET("avx2")
+static void horizontalAVX2(const uint8_t *source,
+                           int16_t *target,
+                           const int16_t *weights,
+                           const int kernelSize,
+                           const int components,
+                           const int first,
+                           const int count)
+{
+  const __m256i round = _mm256_set1_epi32(1 << (FIXED_INTERMEDIATE - 1));
+  int i = first;
+
+  for (; i + 16 <= count; i += 16)
+  {
+    __m256i low = round, high = round;
+
+    for (int t = 0; t < kernelSize; t += 2)
+    {
+      const uint8_t *sample = source + i + t * components;
+      __m256i a = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *) sample));
+      __m256i b = t + 1 < kernelSize
+        ? _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *) (sample + components)))
+        : _mm256_setzero_si256();
+      __m256i w = _mm256_set1_epi32(weightPair(weights, t, kernelSize));
+
+      low = _mm256_add_epi32(low, _mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), w));
+      high = _mm256_add_epi32(high, _mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), w));
+    }
+
+    low = _mm256_srai_epi32(low, FIXED_INTERMEDIATE);
+    high = _mm256_srai_epi32(high, FIXED_INTERMEDIATE);
+    _mm256_storeu_si256((__m256i *) (target + i), _mm256_packs_epi32(low, high));
+  }
+
+  horizontalSSE41(source, target, weights, kernelSize, components, i, count);
+}
+
+
+TARGET("avx2")
+static void verticalAVX2(const int16_t *const *rows,
+                         uint8_t *target,
+                         const int16_t *weights,
+                         const int kernelSize,
+                         const int first,
+                         const int count)
+{
+  const int shift = 2 * FIXED_SHIFT - FIXED_INTERMEDIATE;
+  const __m256i round = _mm256_set1_epi32(1 << (shift - 1));
+  int i = first;
+
+  for (; i + 16 <= count; i += 16)
+  {
+    __m256i low = round, high = round;
+
+    for (int t = 0; t < kernelSize; t += 2)
+    {
+      __m256i a = _mm256_loadu_si256((const __m256i *) (rows[t] + i));
+      __m256i b = t + 1 < kernelSize
+        ? _mm256_loadu_si256((const __m256i *) (rows[t + 1] + i))
+        : _mm256_setzero_si256();
+      __m256i w = _mm256_set1_epi32(weightPair(weights, t, kernelSize));
+
+      low = _mm256_add_epi32(low, _mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), w));
+      high = _mm256_add_epi32(high, _mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), w));
+    }
+
+    low = _mm256_srai_epi32(low, shift);
+    high = _mm256_srai_epi32(high, shift);
+
+    /* Bytes 0-7 and 8-15 end up in the first and third quarter */
+    __m256i packed = _mm256_packs_epi32(low, high);
+    packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(packed, packed), 0xD8);
+    _mm_storeu_si128((__m128i *) (target + i), _mm256_castsi256_si128(packed));
+  }
+
+  verticalSSE41(rows, target, weights, kernelSize, i, count);
+}
+
+
+TARGET("avx2")
+static void fullAVX2(const uint8_t *const *rows,
+                     uint8_t *target,
+                     const int16_t *weights,
+                     const int kernelSize,
+                     const int components,
+                     const int first,
+                     const int count)
+{
+  const __m256i round = _mm256_set1_epi32(1 << (FIXED_SHIFT - 1));
+  int i = first;
+
+  for (; i + 16 <= count; i += 16)
+  {
+    __m256i low = round, high = round;
+
+    for (int r = 0; r < kernelSize; r++)
+    {
+      const int16_t *row = weights + r * kernelSize;
+
+      for (int t = 0; t < kernelSize; t += 2)
+      {
+        const uint8_t *sample = rows[r] + i + t * components;
+        __m256i a = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *) sample));
+        __m256i b = t + 1 < kernelSize
+          ? _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *) (sample + components)))
+          : _mm256_setzero_si256();
+        __m256i w = _mm256_set1_epi32(weightPair(row, t, kernelSize));
+
+        low = _mm256_add_epi32(low, _mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), w));
+        high = _mm256_add_epi32(high, _mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), w));
+      }
+    }
+
+    low = _mm256_srai_epi32(low, FIXED_SHIFT);
+    high = _mm256_srai_epi32(high, FIXED_SHIFT);
+
+    __m256i packed = _mm256_packs_epi32(low, high);
+    packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(packed, packed), 0xD8);
+    _mm_storeu_si128((__m128i *) (target + i), _mm256_castsi256_si128(packed));
+  }
+
+  fullSSE41(rows, target, weights, kernelSize, components, i, count);
+}
+
+#endif
+
+
+static const FixedPasses scalarPasses = {
+  horizontalScalar, verticalScalar, fullScalar, splitScalar, mergeScalar
+};
+
+#ifdef SIMD_X86
+static const FixedPasses sse41Passes = {
+  horizontalSSE41, verticalSSE41, fullSSE41, splitSSE41, mergeSSE41
+};
+
+static const FixedPasses avx2Passes = {
+  horizontalAVX2, verticalAVX2, fullAVX2, splitSSE41, mergeSSE41
+};
+#endif
+
+static const FixedPasses *selected = NULL;
+static InstructionSet selectedSet = SIMD_NONE;
+
+
+static bool isSupported(const InstructionSet set)
+{
+  if (set == SIMD_NONE)
+  {
+    return true;
+  }
+
+#if defined(SIMD_X86) && defined(__GNUC__)
+  __builtin_cpu_init();
+
+  if (set == SIMD_SSE41)
+  {
+    return __builtin_cpu_supports("sse4.1");
+  }
+
+  /* AVX2 variants finish rows off with SSE4.1 */
+  return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("sse4.1");
+
+#elif defined(SIMD_X86) && defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 1);
+  bool sse41 = (info[2] & (1 << 19)) != 0;
+  bool osxsave = (info[2] & (1 << 27)) != 0;
+
+  if (set == SIMD_SSE41)
+  {
+    return sse41;
+  }
+
+  /* The operating system must also save the upper halves of registers */
+  if (!sse41 || !osxsave || (_xgetbv(0) & 6) != 6)
+  {
+    return false;
+  }
+
+  __cpuidex(info, 7, 0);
+  return (info[1] & (1 << 5)) != 0;
+
+#else
+  return false;
+#endif
+}
+
+
+bool selectInstructionSet(const InstructionSet set)
+{
+  if (!isSupported(set))
+  {
+    return false;
+  }
+
+  const FixedPasses *passes = &scalarPasses;
+
+#ifdef SIMD_X86
+  if (set == SIMD_SSE41)
+  {
+    passes = &sse41Passes;
+  }
+  else if (set == SIMD_AVX2)
+  {
+    passes = &avx2Passes;
+  }
+#endif
+
+  selectedSet = set;
+  selected = passes;
+
+  return true;
+}
+
+
+InstructionSet detectInstructionSet(void)
+{
+  if (!selectInstructionSet(SIMD_AVX2) && !selectInstructionSet(SIMD_SSE41))
+  {
+    selectInstructionSet(SIMD_NONE);
+  }
+
+  return selectedSet;
+}
+
+
+const FixedPasses *fixedPasses(void)
+{
+  if (selected == NULL)
+  {
+    detectInstructionSet();
+  }
+
+  return selected;
+}
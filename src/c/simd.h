@@ -0,0 +1,70 @@
+#include <stdint.h>
+
+
+/* Bits of fraction of fixed-point weights, and of those the bits dropped
+   after the first of two separable passes */
+#define FIXED_SHIFT 14
+#define FIXED_INTERMEDIATE 7
+
+
+/** Inner loops of the fixed-point engines, and of planar layouts
+ *
+ * One variant of each exists per instruction set, and all variants
+ * produce identical results. AVX2 shuffles only within each half of a
+ * register, so its table shares the layout loops of SSE4.1. The table
+ * in use is picked once, by detectInstructionSet() or
+ * selectInstructionSet().
+ *
+ * Weights are those of quantiseKernel(), with FIXED_SHIFT bits of
+ * fraction. Values /p first up to /p count are produced, where count
+ * is typically the width of a row times its components.
+ */
+typedef struct
+{
+  /* target[i] = sum(weights[t] * source[i + t * components]) >> 7,
+     saturated to 16 bits */
+  void (*horizontal)(const uint8_t *source,
+                     int16_t *target,
+                     const int16_t *weights,
+                     const int kernelSize,
+                     const int components,
+                     const int first,
+                     const int count);
+
+  /* target[i] = sum(weights[t] * rows[t][i]) >> 21, saturated to 8 bits */
+  void (*vertical)(const int16_t *const *rows,
+                   uint8_t *target,
+                   const int16_t *weights,
+                   const int kernelSize,
+                   const int first,
+                   const int count);
+
+  /* target[i] = sum(weights[r * kernelSize + t] * rows[r][i + t * components]) >> 14,
+     saturated to 8 bits */
+  void (*full)(const uint8_t *const *rows,
+               uint8_t *target,
+               const int16_t *weights,
+               const int kernelSize,
+               const int components,
+               const int first,
+               const int count);
+
+  /* planes[c][i] = source[i * components + c], for pixels first up to count */
+  void (*split)(const uint8_t *source,
+                uint8_t *const *planes,
+                const int components,
+                const int first,
+                const int count);
+
+  /* target[i * components + c] = planes[c][i], for pixels first up to count */
+  void (*merge)(const uint8_t *const *planes,
+                uint8_t *target,
+                const int components,
+                const int first,
+                const int count);
+} FixedPasses;
+
+
+/** Passes of the selected instruction set, detecting it if need be
+ */
+const FixedPasses *fixedPasses(void);